@@ -0,0 +1,66 @@
+#!/bin/sh
+# This is bench_scenarios.sh, the end-to-end benchmark of simulation_code.
+#
+# Each scenario is simulation_code.c with bench_mode 1 and a few of its
+# SIMULATION PARAMETERS changed. It is built with the same flags into its own
+# directory under bench_scenarios/, and run there from the same seeds. The rows
+# of every scenario's Benchmark Report.csv are collected in
+# bench_scenarios.csv, prefixed with the scenario name. A scenario that fails
+# gets a FAILED row with its exit status. The events and the event list peaks
+# are exact, so they diff across builds, while the times and rates show the
+# speed.
+#
+# Usage: sh bench_scenarios.sh [scenario...]  (all scenarios by default)
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-std=c89 -Wall -Wextra -pedantic-errors -O2"}
+ROOT=$(pwd)
+OUT="$ROOT/bench_scenarios.csv"
+
+# The parameter changes of a scenario, as sed expressions on the #define lines.
+scenario_edits() {
+    case "$1" in
+    small)       echo 's/^#define Number_of_customers_required [0-9]*/#define Number_of_customers_required 12000/
+                       s/^#define transient  *[0-9]*/#define transient 2000/
+                       s/^#define n_iter  *[0-9]*/#define n_iter 1/' ;;
+    baseline)    echo '' ;;
+    servers_150) echo 's/^#define lowest_n_servers  *[0-9]*/#define lowest_n_servers 150/
+                       s/^#define highest_n_servers  *[0-9]*/#define highest_n_servers 150/' ;;
+    overload)    echo 's/^#define lowest_n_servers  *[0-9]*/#define lowest_n_servers 36/
+                       s/^#define highest_n_servers  *[0-9]*/#define highest_n_servers 36/' ;;
+    ticks)       echo 's/^#define tick_mode  *0/#define tick_mode 1/' ;;
+    batch)       echo 's/^#define tick_mode  *0/#define tick_mode 1/
+                       s/^#define dispatch_mode  *0/#define dispatch_mode 1/' ;;
+    policy_[1-5]) p=${1#policy_}
+                 echo "s/^#define lowest_policy_number [0-9]*/#define lowest_policy_number $p/
+                       s/^#define highest_policy_number [0-9]*/#define highest_policy_number $p/" ;;
+    *)           echo "Unknown scenario $1" >&2; exit 1 ;;
+    esac
+}
+
+if [ $# -eq 0 ]; then
+    set -- small baseline ticks batch servers_150 overload policy_2 policy_3 policy_4 policy_5
+fi
+
+echo "Scenario,Servers,Policy,Iteration,Events,Events_per_sec,Peak_Event_List,Peak_RSS_KB,Beliefs_Time,Init_Time,Event_Loop_Time,Record_Time,Allocs,Frees,Event_Heap_Bytes,Event_Heap_Growths" > "$OUT"
+for scenario in "$@"; do
+    dir="$ROOT/bench_scenarios/$scenario"
+    mkdir -p "$dir"
+    edits=$(scenario_edits "$scenario") || exit 1
+    sed -e 's/^#define bench_mode  *0/#define bench_mode 1/' -e "$edits" simulation_code.c > "$dir/simulation_code.c"
+    cp Inputs.in "$dir/"
+    if ! $CC $CFLAGS -I"$ROOT" -o "$dir/simulation_code" "$dir/simulation_code.c" simlib.c minheap.c radixheap.c -lm; then
+        echo "$scenario,FAILED,build" >> "$OUT"
+        continue
+    fi
+    echo "Running $scenario" >&2
+    (cd "$dir" && ./simulation_code > run.log 2>&1)
+    status=$?
+    if [ -f "$dir/Benchmark Report.csv" ]; then
+        tail -n +2 "$dir/Benchmark Report.csv" | sed "s/^/$scenario,/" >> "$OUT"
+    fi
+    if [ $status -ne 0 ]; then
+        echo "$scenario,FAILED,exit status $status" >> "$OUT"
+    fi
+done
+cat "$OUT"
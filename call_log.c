@@ -0,0 +1,129 @@
+/* This is call_log.c, the reader of the per-call logs of simulation_code.c
+   (call_log_mode 1).
+
+   Usage: call_log file          summary of the log
+          call_log file csv      every call as a CSV line on standard output
+
+   The summary counts the calls after the warm-up by outcome, with their
+   average wait in seconds.  The CSV has one line per call, in the order the
+   calls ended, with the customer number and the columns of call_log.h, so
+   further statistics only need the log. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "call_log.h"
+
+static int         caller[CALL_LOG_BLOCK];
+static signed char class[CALL_LOG_BLOCK], decision[CALL_LOG_BLOCK],
+                   queue[CALL_LOG_BLOCK], callback_type[CALL_LOG_BLOCK],
+                   outcome[CALL_LOG_BLOCK];
+static short       online_message[CALL_LOG_BLOCK],
+                   offline_message[CALL_LOG_BLOCK], server[CALL_LOG_BLOCK];
+static double      arrival[CALL_LOG_BLOCK];
+static float       wait[CALL_LOG_BLOCK];
+
+static int read_column(void *column, size_t size, long rows, FILE *unit)
+{
+    return fread(column, size, (size_t) rows, unit) == (size_t) rows;
+}
+
+/* Read the next block into the columns, returning its number of calls (0 at
+   the end of the log). */
+
+static long read_block(FILE *unit, const char *name)
+{
+    long rows;
+
+    if(fread(&rows, sizeof(rows), 1, unit) != 1) return 0;
+    if(rows < 1 || rows > CALL_LOG_BLOCK ||
+       !read_column(caller, sizeof(caller[0]), rows, unit) ||
+       !read_column(class, sizeof(class[0]), rows, unit) ||
+       !read_column(arrival, sizeof(arrival[0]), rows, unit) ||
+       !read_column(decision, sizeof(decision[0]), rows, unit) ||
+       !read_column(queue, sizeof(queue[0]), rows, unit) ||
+       !read_column(online_message, sizeof(online_message[0]), rows, unit) ||
+       !read_column(offline_message, sizeof(offline_message[0]), rows, unit) ||
+       !read_column(callback_type, sizeof(callback_type[0]), rows, unit) ||
+       !read_column(wait, sizeof(wait[0]), rows, unit) ||
+       !read_column(outcome, sizeof(outcome[0]), rows, unit) ||
+       !read_column(server, sizeof(server[0]), rows, unit)) {
+        printf("%s ends in the middle of a block\n", name);
+        exit(1);
+    }
+    return rows;
+}
+
+int main(int argc, char *argv[])
+{
+    struct call_log_header header;
+    FILE  *unit;
+    long   rows, row, customer, calls[CALL_CALLBACK_MISSED + 1];
+    double wait_total[CALL_CALLBACK_MISSED + 1];
+    int    csv, kind;
+
+    if(argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "csv") != 0)) {
+        printf("Usage: call_log file [csv]\n");
+        exit(1);
+    }
+    csv  = (argc == 3);
+    unit = fopen(argv[1], "rb");
+    if(unit == NULL) {
+        printf("Could not open call log %s\n", argv[1]);
+        exit(1);
+    }
+    if(fread(&header, sizeof(header), 1, unit) != 1 ||
+       memcmp(header.magic, "SIMCALLS", 8) != 0 ||
+       header.block != CALL_LOG_BLOCK || header.columns != CALL_LOG_COLUMNS) {
+        printf("%s is not a call log of this simulation_code\n", argv[1]);
+        exit(1);
+    }
+
+    if(csv)
+        printf("customer,caller,class,arrival,decision,queue,online_message,"
+               "offline_message,callback_type,wait,outcome,server\n");
+    for(kind = 0; kind <= CALL_CALLBACK_MISSED; ++kind) {
+        calls[kind]      = 0;
+        wait_total[kind] = 0.0;
+    }
+    customer = header.first_customer;
+    while((rows = read_block(unit, argv[1])) > 0) {
+        for(row = 0; row < rows; ++row) {
+            ++customer;
+            if(csv) {
+                printf("%ld,%d,%d,%.2f,%d,%d,%d,%d,%d,%g,%d,%d\n", customer,
+                       caller[row], class[row], arrival[row], decision[row],
+                       queue[row], online_message[row], offline_message[row],
+                       callback_type[row], wait[row], outcome[row],
+                       server[row]);
+                continue;
+            }
+            if(customer < header.warmup_customers) continue;
+            kind = (outcome[row] >= 1 && outcome[row] <= CALL_CALLBACK_MISSED)
+                   ? outcome[row] : 0;
+            ++calls[kind];
+            wait_total[kind] += wait[row];
+        }
+    }
+    fclose(unit);
+    if(csv) return 0;
+
+    /* Summary. */
+
+    printf("%s: servers %ld, policy %ld, iteration %ld%s, customers %ld to "
+           "%ld, warm-up %ld\n", argv[1], header.servers, header.policy,
+           header.iteration, header.antithetic ? " (antithetic)" : "",
+           header.first_customer + 1, customer, header.warmup_customers - 1);
+    for(kind = CALL_ANSWERED; kind <= CALL_CALLBACK_MISSED; ++kind) {
+        printf("  %-16s %10ld calls", kind == CALL_ANSWERED ? "answered" :
+               kind == CALL_ABANDONED ? "abandoned" : "callback missed",
+               calls[kind]);
+        if(calls[kind] > 0)
+            printf(", average wait %.2f seconds", wait_total[kind] /
+                   calls[kind] * header.period_length);
+        printf("\n");
+    }
+    if(calls[0] > 0)
+        printf("  %-16s %10ld calls\n", "unknown outcome", calls[0]);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef __CALL_LOG__
+#define __CALL_LOG__
+/* This is call_log.h, the format of the per-call logs written by
+   simulation_code.c (call_log_mode 1) and read by call_log.c.
+
+   A log is a struct call_log_header followed by blocks of at most
+   CALL_LOG_BLOCK calls.  A block is its number of calls n, as a long,
+   followed by each column in turn as an array of n values:
+
+       caller           int          caller number
+       class            signed char  latent class
+       arrival          double       time the call arrived, in periods
+       decision         signed char  CALL_DECISION_*
+       queue            signed char  0 = none, 1 = online, 2 = offline
+       online_message   short        message subset of the online queue
+       offline_message  short        message subset of the callback
+       callback_type    signed char  0 = none, 1 = scheduled, 2 = hold spot,
+                                     3 = window
+       wait             float        periods from arrival to the outcome
+       outcome          signed char  CALL_*
+       server           short        server that answered (0 if none)
+
+   The messages are -1 for callers answered on arrival, who get none.  Calls
+   are logged in the order they end, so the call in row r (from 0) of a log is
+   customer first_customer + r + 1 of the run, and the warm-up is the
+   customers up to warmup_customers - 1. */
+
+#define CALL_LOG_BLOCK   65536  /* Calls per block. */
+#define CALL_LOG_COLUMNS 11     /* Columns per block. */
+
+#define CALL_DECISION_ABANDON  0 /* Abandoned on arrival. */
+#define CALL_DECISION_ONLINE   1 /* Joined the online queue. */
+#define CALL_DECISION_CALLBACK 2 /* Accepted a callback. */
+#define CALL_DECISION_NONE     3 /* Answered on arrival, without a choice. */
+
+#define CALL_ANSWERED         1 /* Answered by a server. */
+#define CALL_ABANDONED        2 /* Abandoned, on arrival or in the online queue. */
+#define CALL_CALLBACK_MISSED  3 /* Did not answer the callback. */
+
+struct call_log_header {
+    char    magic[8];           /* "SIMCALLS". */
+    long    version;
+    long    block;              /* CALL_LOG_BLOCK. */
+    long    columns;            /* CALL_LOG_COLUMNS. */
+    long    servers;            /* Servers of the run. */
+    long    policy;             /* Policy of the run. */
+    long    iteration;          /* Iteration of the run. */
+    long    antithetic;         /* 1 for the antithetic partner of a pair. */
+    long    first_customer;     /* Customers done before the log started (the
+                                   warm-up, for a run restored from a
+                                   checkpoint). */
+    long    warmup_customers;   /* Customers of the warm-up, filled in when the
+                                   log is closed. */
+    double  period_length;      /* Seconds per period. */
+};
+
+#endif
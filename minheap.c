@@ -16,6 +16,9 @@ struct MinHeapHandle {
     size_t elements_per_block;
     size_t element_count;
     void * temp;
+    size_t allocations; /* malloc calls. */
+    size_t frees;       /* free calls, apart from minheap_destroy. */
+    size_t growths;     /* Calls to _realloc. */
 };
 
 struct MinHeapHandle *
@@ -46,6 +49,9 @@ struct MinHeapHandle *
         free(result);
         return NULL;
     }
+    result->allocations = 4;
+    result->frees = 0;
+    result->growths = 0;
 
     return result;
 }
@@ -144,6 +150,7 @@ static void _realloc(struct MinHeapHandle * heap)
     size_t old_block_count;
     size_t i;
 
+    ++heap->growths;
     heap->allocated_elements *= 2;
     if (heap->allocated_elements > heap->elements_per_block) {
         old_block_count = heap->allocated_blocks;
@@ -154,6 +161,7 @@ static void _realloc(struct MinHeapHandle * heap)
             printf("out of memory");
             exit(1);
         }
+        ++heap->allocations;
         memcpy(new_blocks, heap->element_array, old_block_count * sizeof(void *));
         /* Special case when first transitioning to block allocation. We need to
            upgrade the first block pointer to a full block size and copy the data
@@ -167,6 +175,8 @@ static void _realloc(struct MinHeapHandle * heap)
             memcpy(new_blocks[0], heap->element_array[0],
                    heap->element_count * heap->element_size);
             free(heap->element_array[0]);
+            heap->allocations += 1;
+            heap->frees += 1;
         }
         for (i = old_block_count; i < heap->allocated_blocks; ++i) {
             new_blocks[i] = malloc(heap->elements_per_block * heap->element_size);
@@ -174,8 +184,10 @@ static void _realloc(struct MinHeapHandle * heap)
                 printf("out of memory");
                 exit(1);
             }
+            ++heap->allocations;
         }
         free(heap->element_array);
+        ++heap->frees;
         heap->element_array = new_blocks;
     } else {
         new_array = malloc(heap->allocated_elements * heap->element_size);
@@ -187,6 +199,8 @@ static void _realloc(struct MinHeapHandle * heap)
                heap->element_count * heap->element_size);
         free(heap->element_array[0]);
         heap->element_array[0] = new_array;
+        ++heap->allocations;
+        ++heap->frees;
     }
 }
 
@@ -232,3 +246,25 @@ void minheap_delete_minimum(struct MinHeapHandle * heap)
     --heap->element_count;
     _bubble_down(heap, 0);
 }
+
+void * minheap_element(struct MinHeapHandle * heap, size_t index)
+{
+    return _element_at(heap, index);
+}
+
+size_t minheap_bytes(struct MinHeapHandle * heap)
+{
+    /* The handle, the block table, the elements and the swap buffer. */
+    return sizeof(struct MinHeapHandle) +
+           heap->allocated_blocks * sizeof(void *) +
+           heap->allocated_elements * heap->element_size +
+           heap->element_size;
+}
+
+void minheap_counts(struct MinHeapHandle * heap, size_t * allocations,
+    size_t * frees, size_t * growths)
+{
+    *allocations = heap->allocations;
+    *frees = heap->frees;
+    *growths = heap->growths;
+}
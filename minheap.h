@@ -24,5 +24,17 @@ void * minheap_minimum(struct MinHeapHandle * heap);
 void minheap_insert(struct MinHeapHandle * heap, void * element);
 void minheap_delete_minimum(struct MinHeapHandle * heap);
 
+/* Access the element at a position of the heap array (0 <= index < size).
+   Inserting the elements into an empty heap in position order rebuilds
+   the same array, so this is enough to save and restore a heap. */
+void * minheap_element(struct MinHeapHandle * heap, size_t index);
+
+/* Memory telemetry: the bytes the heap holds, and the malloc and free calls
+   and growths since it was constructed (the frees of minheap_destroy are
+   not counted). */
+size_t minheap_bytes(struct MinHeapHandle * heap);
+void minheap_counts(struct MinHeapHandle * heap, size_t * allocations,
+    size_t * frees, size_t * growths);
+
 #endif
 
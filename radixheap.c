@@ -0,0 +1,346 @@
+#include "radixheap.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Bucket 0 and one bucket per bit of a 64-bit key. */
+#define RADIXHEAP_BUCKETS 65
+
+/* Elements per chunk.  A bucket is a list of chunks, so it grows without
+   copying, and chunks that empty are kept for reuse. */
+#define RADIXHEAP_CHUNK 1024
+
+struct _Chunk {
+    struct _Chunk * next;
+    size_t count;       /* Elements written to the chunk. */
+    long * keys;        /* RADIXHEAP_CHUNK keys, after the struct. */
+    char * elements;    /* RADIXHEAP_CHUNK elements, after the keys. */
+};
+
+struct _Bucket {
+    struct _Chunk * first;
+    struct _Chunk * last;
+    size_t head;        /* First element of the first chunk not yet removed. */
+    size_t count;       /* Elements in the bucket. */
+};
+
+struct RadixHeapHandle {
+    size_t element_size;
+    struct _Bucket buckets[RADIXHEAP_BUCKETS];
+    struct _Chunk * spare; /* Empty chunks. */
+    long last;          /* Key of the last minimum. */
+    size_t element_count;
+    size_t chunks;      /* Chunks allocated, in buckets or spare. */
+    size_t allocations; /* malloc calls. */
+    size_t frees;       /* free calls, apart from radixheap_destroy. */
+    size_t growths;     /* Calls to _new_chunk that allocated. */
+};
+
+struct RadixHeapHandle * radixheap_construct(size_t element_size)
+{
+    struct RadixHeapHandle * result = malloc(sizeof(struct RadixHeapHandle));
+    size_t i;
+
+    if (result == NULL) {
+        return NULL;
+    }
+    result->element_size = element_size;
+    for (i = 0; i < RADIXHEAP_BUCKETS; ++i) {
+        result->buckets[i].first = NULL;
+        result->buckets[i].last = NULL;
+        result->buckets[i].head = 0;
+        result->buckets[i].count = 0;
+    }
+    result->spare = NULL;
+    result->last = 0;
+    result->element_count = 0;
+    result->chunks = 0;
+    result->allocations = 1;
+    result->frees = 0;
+    result->growths = 0;
+
+    return result;
+}
+
+static void _free_chunks(struct _Chunk * chunk)
+{
+    struct _Chunk * next;
+
+    for (; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+}
+
+void radixheap_destroy(struct RadixHeapHandle * heap)
+{
+    size_t i;
+
+    for (i = 0; i < RADIXHEAP_BUCKETS; ++i) {
+        _free_chunks(heap->buckets[i].first);
+    }
+    _free_chunks(heap->spare);
+    free(heap);
+}
+
+/* The bucket of key: 0 if it equals the last minimum, else 1 + the highest
+   bit in which they differ. */
+static size_t _bucket_index(struct RadixHeapHandle * heap, long key)
+{
+    unsigned long bits = (unsigned long) key ^ (unsigned long) heap->last;
+    size_t index;
+
+    if (bits == 0) {
+        return 0;
+    }
+    index = 1;
+    while (bits >= 0x10000UL) {
+        bits >>= 16;
+        index += 16;
+    }
+    if (bits >= 0x100) {
+        bits >>= 8;
+        index += 8;
+    }
+    if (bits >= 0x10) {
+        bits >>= 4;
+        index += 4;
+    }
+    if (bits >= 0x4) {
+        bits >>= 2;
+        index += 2;
+    }
+    if (bits >= 0x2) {
+        index += 1;
+    }
+    return index;
+}
+
+/* An empty chunk, from the spare ones if there are any.  The keys and
+   elements follow the struct in the same allocation. */
+static struct _Chunk * _new_chunk(struct RadixHeapHandle * heap)
+{
+    struct _Chunk * chunk = heap->spare;
+
+    if (chunk != NULL) {
+        heap->spare = chunk->next;
+    } else {
+        chunk = malloc(sizeof(struct _Chunk) +
+                       RADIXHEAP_CHUNK * (sizeof(long) + heap->element_size));
+        if (chunk == NULL) {
+            printf("out of memory");
+            exit(1);
+        }
+        chunk->keys = (long *)(chunk + 1);
+        chunk->elements = (char *)(chunk->keys + RADIXHEAP_CHUNK);
+        ++heap->allocations;
+        ++heap->growths;
+        ++heap->chunks;
+    }
+    chunk->next = NULL;
+    chunk->count = 0;
+    return chunk;
+}
+
+static void _spare_chunk(struct RadixHeapHandle * heap, struct _Chunk * chunk)
+{
+    chunk->next = heap->spare;
+    heap->spare = chunk;
+}
+
+static void _push(struct RadixHeapHandle * heap, size_t index, long key, void * element)
+{
+    struct _Bucket * bucket = &heap->buckets[index];
+    struct _Chunk * chunk = bucket->last;
+
+    if (chunk == NULL || chunk->count == RADIXHEAP_CHUNK) {
+        chunk = _new_chunk(heap);
+        if (bucket->last == NULL) {
+            bucket->first = chunk;
+        } else {
+            bucket->last->next = chunk;
+        }
+        bucket->last = chunk;
+    }
+    chunk->keys[chunk->count] = key;
+    memcpy(chunk->elements + chunk->count * heap->element_size, element, heap->element_size);
+    ++chunk->count;
+    ++bucket->count;
+}
+
+/* Make sure bucket 0 holds the minimum unless the heap is empty, by
+   spreading the lowest nonempty bucket around its smallest key.  Its
+   elements all go to lower buckets, in their order. */
+static void _settle(struct RadixHeapHandle * heap)
+{
+    struct _Bucket * bucket;
+    struct _Chunk * chunk;
+    struct _Chunk * next;
+    size_t i, j;
+    long minimum;
+
+    if (heap->buckets[0].count > 0 || heap->element_count == 0) {
+        return;
+    }
+
+    for (i = 1; heap->buckets[i].count == 0; ++i)
+        ;
+    bucket = &heap->buckets[i];
+
+    minimum = bucket->first->keys[0];
+    for (chunk = bucket->first; chunk != NULL; chunk = chunk->next) {
+        for (j = 0; j < chunk->count; ++j) {
+            if (chunk->keys[j] < minimum) {
+                minimum = chunk->keys[j];
+            }
+        }
+    }
+    heap->last = minimum;
+
+    for (chunk = bucket->first; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        for (j = 0; j < chunk->count; ++j) {
+            _push(heap, _bucket_index(heap, chunk->keys[j]), chunk->keys[j],
+                  chunk->elements + j * heap->element_size);
+        }
+        _spare_chunk(heap, chunk);
+    }
+    bucket->first = NULL;
+    bucket->last = NULL;
+    bucket->count = 0;
+}
+
+bool radixheap_empty(struct RadixHeapHandle * heap)
+{
+    return heap->element_count == 0;
+}
+
+size_t radixheap_size(struct RadixHeapHandle * heap)
+{
+    return heap->element_count;
+}
+
+void radixheap_insert(struct RadixHeapHandle * heap, long key, void * element)
+{
+    if (key < heap->last) {
+        printf("radixheap key %ld is below the last minimum %ld", key, heap->last);
+        exit(1);
+    }
+    _push(heap, _bucket_index(heap, key), key, element);
+    ++heap->element_count;
+}
+
+void * radixheap_minimum(struct RadixHeapHandle * heap)
+{
+    struct _Bucket * zero = &heap->buckets[0];
+
+    _settle(heap);
+    return zero->first->elements + zero->head * heap->element_size;
+}
+
+long radixheap_minimum_key(struct RadixHeapHandle * heap)
+{
+    _settle(heap);
+    return heap->last;
+}
+
+void radixheap_delete_minimum(struct RadixHeapHandle * heap)
+{
+    struct _Bucket * zero = &heap->buckets[0];
+    struct _Chunk * chunk;
+
+    if (heap->element_count == 0) {
+        return;
+    }
+    _settle(heap);
+    ++zero->head;
+    --zero->count;
+    --heap->element_count;
+
+    /* Done with the first chunk once it is read up to where it was
+       written, unless more may still be written to it. */
+    chunk = zero->first;
+    if (zero->head == chunk->count && (chunk->count == RADIXHEAP_CHUNK || zero->count == 0)) {
+        zero->first = chunk->next;
+        if (zero->first == NULL) {
+            zero->last = NULL;
+        }
+        zero->head = 0;
+        _spare_chunk(heap, chunk);
+    }
+}
+
+size_t radixheap_delete_minimums(struct RadixHeapHandle * heap, void * buffer,
+    size_t max)
+{
+    /* Bucket 0 holds exactly the elements with the minimum key, so they are
+       copied out a chunk at a time. */
+    struct _Bucket * zero = &heap->buckets[0];
+    struct _Chunk * chunk;
+    size_t taken = 0;
+    size_t run;
+
+    _settle(heap);
+    while (taken < max && zero->count > 0) {
+        chunk = zero->first;
+        run = chunk->count - zero->head;
+        if (run > max - taken) {
+            run = max - taken;
+        }
+        memcpy((char *)buffer + taken * heap->element_size,
+               chunk->elements + zero->head * heap->element_size,
+               run * heap->element_size);
+        taken += run;
+        zero->head += run;
+        zero->count -= run;
+        heap->element_count -= run;
+        if (zero->head == chunk->count && (chunk->count == RADIXHEAP_CHUNK || zero->count == 0)) {
+            zero->first = chunk->next;
+            if (zero->first == NULL) {
+                zero->last = NULL;
+            }
+            zero->head = 0;
+            _spare_chunk(heap, chunk);
+        }
+    }
+    return taken;
+}
+
+void * radixheap_element(struct RadixHeapHandle * heap, size_t index)
+{
+    struct _Bucket * bucket;
+    struct _Chunk * chunk;
+    size_t i, skip;
+
+    for (i = 0; i < RADIXHEAP_BUCKETS; ++i) {
+        bucket = &heap->buckets[i];
+        if (index >= bucket->count) {
+            index -= bucket->count;
+            continue;
+        }
+        skip = bucket->head;
+        for (chunk = bucket->first; chunk != NULL; chunk = chunk->next) {
+            if (index < chunk->count - skip) {
+                return chunk->elements + (skip + index) * heap->element_size;
+            }
+            index -= chunk->count - skip;
+            skip = 0;
+        }
+    }
+    return NULL;
+}
+
+size_t radixheap_bytes(struct RadixHeapHandle * heap)
+{
+    /* The handle and the chunks. */
+    return sizeof(struct RadixHeapHandle) + heap->chunks *
+           (sizeof(struct _Chunk) + RADIXHEAP_CHUNK * (sizeof(long) + heap->element_size));
+}
+
+void radixheap_counts(struct RadixHeapHandle * heap, size_t * allocations,
+    size_t * frees, size_t * growths)
+{
+    *allocations = heap->allocations;
+    *frees = heap->frees;
+    *growths = heap->growths;
+}
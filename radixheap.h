@@ -0,0 +1,56 @@
+#ifndef __RADIXHEAP_H__
+#define __RADIXHEAP_H__
+
+/* A monotone priority queue on integer keys: no key inserted may be smaller
+   than the last minimum key looked at (radixheap_minimum or
+   radixheap_minimum_key) or removed, as with event times.  Like the
+   minheap, it treats elements as opaque blocks of element_size bytes, which
+   it copies.  Elements with equal keys come out in the order they were
+   inserted.
+
+   An element sits in the bucket of the highest bit in which its key differs
+   from the last minimum (bucket 0 if equal).  Only bucket 0 is ever
+   searched in order; when it runs out, the lowest nonempty bucket is spread
+   over the buckets below it around its smallest key.  An element moves down
+   at most once per bit, so insert and delete take amortized time in the
+   number of bits of the keys and make no key comparisons beyond those. */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct RadixHeapHandle;
+
+struct RadixHeapHandle * radixheap_construct(size_t element_size);
+void radixheap_destroy(struct RadixHeapHandle * heap);
+
+bool radixheap_empty(struct RadixHeapHandle * heap);
+size_t radixheap_size(struct RadixHeapHandle * heap);
+
+/* Insert a copy of element with key (at least the last minimum looked at or
+   removed). */
+void radixheap_insert(struct RadixHeapHandle * heap, long key, void * element);
+
+/* Access the minimum element and its key. Does not remove it. */
+void * radixheap_minimum(struct RadixHeapHandle * heap);
+long radixheap_minimum_key(struct RadixHeapHandle * heap);
+void radixheap_delete_minimum(struct RadixHeapHandle * heap);
+
+/* Remove up to max of the elements with the minimum key, copying them to
+   buffer one after the other in the order they were inserted.  Returns the
+   number removed (0 if the heap is empty). */
+size_t radixheap_delete_minimums(struct RadixHeapHandle * heap, void * buffer,
+    size_t max);
+
+/* Access the element at a position (0 <= index < size), in bucket order.
+   Inserting the elements into an empty heap in position order keeps the
+   order of equal keys, so this is enough to save and restore a heap. */
+void * radixheap_element(struct RadixHeapHandle * heap, size_t index);
+
+/* Memory telemetry, as for the minheap: the bytes the heap holds, and the
+   malloc and free calls and growths since it was constructed (the frees of
+   radixheap_destroy are not counted). */
+size_t radixheap_bytes(struct RadixHeapHandle * heap);
+void radixheap_counts(struct RadixHeapHandle * heap, size_t * allocations,
+    size_t * frees, size_t * growths);
+
+#endif
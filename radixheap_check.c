@@ -0,0 +1,158 @@
+/* This is radixheap_check.c, a self-check of the radix heap against the
+   minheap.
+
+   Usage: radixheap_check [operations]   (1000000 by default)
+
+   Random inserts and deletes are applied to a radix heap and to a minheap
+   ordered by key and then by insertion number, which is the order the radix
+   heap promises: smallest key first, equal keys in the order they were
+   inserted.  The keys are drawn just above the last minimum looked at,
+   mostly from a few values so that many are equal, and now and then far
+   above it so that the high buckets are used.  Deletes take one minimum, or
+   a few elements of the minimum key at once with radixheap_delete_minimums
+   as timing_batch does.  After every operation the two heaps must have
+   the same size and the same minimum element.  Every so often the radix heap
+   is also rebuilt from its elements in radixheap_element order, as a
+   checkpoint restore does, which must keep that order.  The program prints
+   OK and exits with 0, or prints the first difference and exits with 1. */
+
+#include "minheap.h"
+#include "radixheap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK_OPERATIONS 1000000L /* Operations by default. */
+#define CHECK_REBUILD    50000L   /* Operations between rebuilds. */
+#define CHECK_SEED       12345UL  /* Seed of the generator of the operations. */
+#define CHECK_BATCH      8        /* Most elements of one batch delete. */
+
+struct check_element {
+    long key;
+    long number;                /* Insertion number, to order equal keys. */
+};
+
+static unsigned long check_state = CHECK_SEED;
+
+/* A uniform integer in [0, range), from a 64-bit linear congruential
+   generator (Knuth's MMIX constants), which is enough to pick operations. */
+
+static unsigned long check_random(unsigned long range)
+{
+    check_state = check_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned long) ((check_state >> 33) % range);
+}
+
+static bool check_later(void *left, void *right)
+{
+    struct check_element *a = (struct check_element *) left;
+    struct check_element *b = (struct check_element *) right;
+
+    return a->key > b->key || (a->key == b->key && a->number > b->number);
+}
+
+static void check_fail(long operation, const char *what)
+{
+    printf("radixheap_check: operation %ld: %s\n", operation, what);
+    exit(1);
+}
+
+/* A copy of heap with its elements inserted in radixheap_element order. */
+
+static struct RadixHeapHandle *check_rebuild(struct RadixHeapHandle *heap)
+{
+    struct RadixHeapHandle *copy = radixheap_construct(sizeof(struct check_element));
+    struct check_element *element;
+    size_t i, size = radixheap_size(heap);
+
+    if(copy == NULL) {
+        printf("out of memory");
+        exit(1);
+    }
+    for(i = 0; i < size; ++i) {
+        element = (struct check_element *) radixheap_element(heap, i);
+        radixheap_insert(copy, element->key, element);
+    }
+    radixheap_destroy(heap);
+    return copy;
+}
+
+int main(int argc, char *argv[])
+{
+    struct RadixHeapHandle *radix;
+    struct MinHeapHandle   *reference;
+    struct check_element    element, *got, *expected, batch[CHECK_BATCH];
+    long   operations, operation, last, number;
+    size_t count, most, j;
+
+    operations = (argc > 1) ? atol(argv[1]) : CHECK_OPERATIONS;
+    radix     = radixheap_construct(sizeof(struct check_element));
+    reference = minheap_construct(sizeof(struct check_element), check_later);
+    if(radix == NULL || reference == NULL) {
+        printf("out of memory");
+        exit(1);
+    }
+
+    last   = 0;
+    number = 0;
+    for(operation = 1; operation <= operations; ++operation) {
+
+        /* Insert a little more often than delete, so the heaps grow and
+           shrink in turns of a few thousand elements. */
+
+        if(minheap_empty(reference) ||
+           check_random(1000) < ((operation / 20000) % 2 == 0 ? 550UL : 450UL)) {
+            switch(check_random(4)) {
+                case 0:  element.key = last; break;
+                case 1:  element.key = last + (long) check_random(4); break;
+                case 2:  element.key = last + (long) check_random(1000); break;
+                default: element.key = last + (long) check_random(1UL << 40); break;
+            }
+            element.number = ++number;
+            radixheap_insert(radix, element.key, &element);
+            minheap_insert(reference, &element);
+        }
+        else if(check_random(2) == 0) {
+            expected = (struct check_element *) minheap_minimum(reference);
+            if(radixheap_minimum_key(radix) != expected->key)
+                check_fail(operation, "the minimum key differs");
+            radixheap_delete_minimum(radix);
+            minheap_delete_minimum(reference);
+        }
+        else {
+            most  = 1 + (size_t) check_random(CHECK_BATCH);
+            count = radixheap_delete_minimums(radix, batch, most);
+            if(count == 0)
+                check_fail(operation, "the batch delete took nothing");
+            for(j = 0; j < count; ++j) {
+                expected = (struct check_element *) minheap_minimum(reference);
+                if(batch[j].key != batch[0].key || batch[j].key != expected->key ||
+                   batch[j].number != expected->number)
+                    check_fail(operation, "the batch delete differs");
+                minheap_delete_minimum(reference);
+            }
+            if(count < most && !minheap_empty(reference) &&
+               ((struct check_element *) minheap_minimum(reference))->key == batch[0].key)
+                check_fail(operation, "the batch delete stopped early");
+        }
+
+        if(radixheap_size(radix) != minheap_size(reference))
+            check_fail(operation, "the sizes differ");
+        if(!minheap_empty(reference)) {
+            got      = (struct check_element *) radixheap_minimum(radix);
+            expected = (struct check_element *) minheap_minimum(reference);
+            if(got->key != expected->key || got->number != expected->number)
+                check_fail(operation, "the minimum element differs (equal keys out of order?)");
+            last = expected->key;
+        }
+        else if(!radixheap_empty(radix))
+            check_fail(operation, "the radix heap is not empty");
+
+        if(operation % CHECK_REBUILD == 0)
+            radix = check_rebuild(radix);
+    }
+
+    radixheap_destroy(radix);
+    minheap_destroy(reference);
+    printf("radixheap_check: OK, %ld operations\n", operations);
+    return 0;
+}
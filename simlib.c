@@ -1,10 +1,18 @@
 /* This is simlib.c (adapted from SUPERSIMLIB, written by Gregory Glockner). */
 
-/* Include files. */
+/* Include files.  Checkpoints are read back with mmap, which is POSIX. */
+
+#define _POSIX_C_SOURCE 200112L
 
 #include "simlib.h"
 #include "minheap.h"
+#include "radixheap.h"
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 /* Declare simlib global variables. */
 
@@ -12,9 +20,192 @@ int    *list_rank, *list_size, next_event_type, maxatr = 0, maxlist = 0;
 double *transfer, sim_time, prob_distrib[26];
 struct master **head, **tail;
 
+/* Events removed by timing, and the largest size of the event list, since
+   init_simlib. */
+long   events_processed, event_list_peak;
+
 struct MinHeapHandle * event_heap;
 size_t event_alloc_size;
 
+/* Integer-tick event list (event_ticks): while event_tick > 0, the events
+   are kept in event_radix, keyed on their times in ticks of event_tick,
+   instead of in event_heap. */
+static struct RadixHeapHandle *event_radix;
+static double event_tick;
+
+/* Memory telemetry since init_simlib: allocations and frees by subsystem,
+   those of the event heaps that checkpoint_restore replaced, and the longest
+   length of each list (kept apart from its timest statistics, which
+   timest_restart clears at the end of a warm-up). */
+static long   memory_allocs[MEM_SIZE], memory_frees[MEM_SIZE];
+static long   list_peak[LIST_SIZE];
+static long   memory_heap_allocs, memory_heap_frees, memory_heap_growths;
+static int    memory_in_filest;     /* out_filest also writes out_memory. */
+
+static void *memory_alloc(size_t size, int subsystem)
+{
+
+/* Allocate size bytes, set to zero, for subsystem.  Stop the simulation if
+   memory runs out. */
+
+    void *block;
+
+    block = calloc(1, size);
+    if(block == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    ++memory_allocs[subsystem];
+    return block;
+}
+
+static void memory_free(void *block, int subsystem)
+{
+    if(block == NULL) return;
+    free(block);
+    ++memory_frees[subsystem];
+}
+
+/* Event trace.  The run is single-threaded, so the buffer needs no locks; it is
+   written (or read) with one call per TRACE_BUFFER events.  When no trace is
+   on, timing only tests trace_mode. */
+static int    trace_mode;           /* 0, TRACE_RECORD or TRACE_REPLAY. */
+static FILE  *trace_unit;
+static struct trace_record trace_buffer[TRACE_BUFFER];
+static int    trace_count, trace_next;  /* Records in the buffer, next to check. */
+static long   trace_print_from, trace_first;
+static int    trace_diverged;
+
+static void trace_event(void);
+
+static size_t event_count(void)
+{
+    return (event_tick > 0.0) ? radixheap_size(event_radix) : minheap_size(event_heap);
+}
+
+static void *event_element(size_t index)
+{
+    return (event_tick > 0.0) ? radixheap_element(event_radix, index)
+                              : minheap_element(event_heap, index);
+}
+
+static void event_radix_destroy(void)
+{
+
+/* Destroy the radix heap, keeping its memory telemetry. */
+
+    size_t heap_allocs, heap_frees, heap_growths;
+
+    radixheap_counts(event_radix, &heap_allocs, &heap_frees, &heap_growths);
+    memory_heap_allocs  += heap_allocs;
+    memory_heap_frees   += heap_frees;
+    memory_heap_growths += heap_growths;
+    radixheap_destroy(event_radix);
+    event_radix = NULL;
+}
+
+static void event_insert(double *record)
+{
+
+/* Insert an event record into the event list.  In tick mode its time must
+   be a whole number of ticks, and it is set to exactly that number times the
+   tick, so times that round to the same tick are equal. */
+
+    double ticks;
+    long   key;
+
+    if(event_tick > 0.0) {
+        ticks = record[EVENT_TIME] / event_tick;
+        key   = (long) floor(ticks + 0.5);
+        if(fabs(ticks - key) > TICK_TOLERANCE) {
+            printf("\nEvent type %f at time %f is not on a tick of %f\n",
+                record[EVENT_TYPE], record[EVENT_TIME], event_tick);
+            exit(1);
+        }
+        record[EVENT_TIME] = key * event_tick;
+        radixheap_insert(event_radix, key, record);
+    } else
+        minheap_insert(event_heap, record);
+}
+
+#ifdef SIMLIB_PROFILE
+/* Profiling counters, compiled in with -DSIMLIB_PROFILE and written by
+   out_profile (also at cleanup_simlib).  Events, schedules and list calls are
+   all counted; times come from reading the clock on one call in
+   PROFILE_SAMPLE.  The handler time of an event is the time from the end of
+   the timing call that removed it to the next timing call, so it includes the
+   event_schedule and list calls the model made for it.  Event types above
+   MAX_EVENT_TYPE are counted as type 0. */
+static long   profile_events[MAX_EVENT_TYPE + 1];
+static long   profile_handler_samples[MAX_EVENT_TYPE + 1];
+static double profile_handler_time[MAX_EVENT_TYPE + 1];
+static long   profile_timing_samples, profile_schedules, profile_schedule_samples;
+static double profile_timing_time, profile_schedule_time;
+static long   profile_files[LIST_SIZE], profile_removes[LIST_SIZE];
+static int    profile_type;     /* Type of the sampled event being handled, or -1. */
+static double profile_clock;    /* Clock at the end of its timing call. */
+
+static double profile_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1.E-9 * now.tv_nsec;
+}
+#endif
+
+/* Accumulators for sampst and timest. */
+static struct sampst_accumulator sampst_acc[SVAR_SIZE];
+static struct timest_accumulator timest_acc[TVAR_SIZE];
+
+/* Quantile sketches of the sampst variables that have them (else NULL). */
+static struct quantile_sketch *sampst_sketch[SVAR_SIZE];
+
+/* Batch means of the batchst variables. */
+static double batch_mean[BVAR_SIZE][BATCH_SLOTS], batch_sum[BVAR_SIZE];
+static long   batch_size[BVAR_SIZE], batch_fill[BVAR_SIZE];
+static int    batch_count[BVAR_SIZE];
+
+/* Antithetic-pair statistics of the pairst variables: the first member of
+   an incomplete pair, and running means and sums of squared deviations
+   (Welford) of the pair averages and of each member. */
+static double pair_first[PVAR_SIZE];
+static double pair_mean[PVAR_SIZE], pair_m2[PVAR_SIZE];
+static double member_mean[PVAR_SIZE][2], member_m2[PVAR_SIZE][2];
+static long   pair_count[PVAR_SIZE];
+static int    pair_pending[PVAR_SIZE];
+
+/* Control-variate statistics of the cvst variables: sums of the output,
+   the controls, their squares and cross products, all taken relative to
+   the first observation to avoid cancellation. */
+static double cv_shift_y[CVAR_SIZE], cv_shift_c[CVAR_SIZE][MAX_CONTROL];
+static double cv_sum_y[CVAR_SIZE], cv_sum_yy[CVAR_SIZE];
+static double cv_sum_c[CVAR_SIZE][MAX_CONTROL], cv_sum_yc[CVAR_SIZE][MAX_CONTROL];
+static double cv_sum_cc[CVAR_SIZE][MAX_CONTROL][MAX_CONTROL];
+static long   cv_count[CVAR_SIZE];
+
+/* Streams that return antithetic numbers 1 - u (see lcgrand_antithetic). */
+static int    lcgrand_flip[MAX_STREAM + 1];
+
+/* State of the MSER warm-up detector. */
+static double *mser_means;          /* Batch means so far. */
+static long    mser_count, mser_alloc, mser_point;
+static int     mser_in_batch;
+static double  mser_batch_sum;
+
+/* Time series (series_start): series_columns + 1 columns of series_alloc
+   samples each in one block, column 0 holding the sample times. */
+static double *series_values;
+static long    series_alloc, series_count, series_dropped;
+static int     series_columns;
+static double  series_interval, series_time;  /* Time of the next sample. */
+
+/* Model memory saved and restored with checkpoints. */
+static void   *region_address[MAX_REGION];
+static size_t  region_size[MAX_REGION];
+static int     checkpoint_regions;
+static char    checkpoint_key_text[CHECKPOINT_KEY];
+
 /* File local helper function */
 static void pprint_out(FILE *unit, int i);
 
@@ -41,31 +232,21 @@ void init_simlib()
 
     /* Allocate space for the lists. */
 
-    list_rank = (int *)            calloc(listsize,   sizeof(int));
-    if (list_rank == NULL) {
-        printf("Out of memory\n");
-        exit(1);
-    }
-    list_size = (int *)            calloc(listsize,   sizeof(int));
-    if (list_size == NULL) {
-        printf("Out of memory\n");
-        exit(1);
-    }
-    head      = (struct master **) calloc(listsize,   sizeof(struct master *));
-    if (head == NULL) {
-        printf("Out of memory\n");
-        exit(1);
-    }
-    tail      = (struct master **) calloc(listsize,   sizeof(struct master *));
-    if (tail == NULL) {
-        printf("Out of memory\n");
-        exit(1);
-    }
-    transfer  = (double *)         calloc(maxatr + 1, sizeof(double));
-    if (transfer == NULL) {
-        printf("Out of memory\n");
-        exit(1);
+    for(list = 1; list <= MAX_MEM; ++list) {
+        memory_allocs[list] = 0;
+        memory_frees[list]  = 0;
     }
+    memory_heap_allocs  = 0;
+    memory_heap_frees   = 0;
+    memory_heap_growths = 0;
+    for(list = 0; list <= MAX_LIST; ++list)
+        list_peak[list] = 0;
+
+    list_rank = (int *)            memory_alloc(listsize * sizeof(int), MEM_CORE);
+    list_size = (int *)            memory_alloc(listsize * sizeof(int), MEM_CORE);
+    head      = (struct master **) memory_alloc(listsize * sizeof(struct master *), MEM_CORE);
+    tail      = (struct master **) memory_alloc(listsize * sizeof(struct master *), MEM_CORE);
+    transfer  = (double *)         memory_alloc((maxatr + 1) * sizeof(double), MEM_CORE);
 
     /* Initialize list attributes. */
 
@@ -84,8 +265,36 @@ void init_simlib()
 
     sampst(0.0, 0);
     timest(0.0, 0);
+    batchst(0.0, 0);
+    cvst(0.0, NULL, 0);
+    mser_init();
+    series_stop();
+    checkpoint_regions = 0;
+    checkpoint_key_text[0] = '\0';
+    events_processed   = 0;
+    event_list_peak    = 0;
+
+#ifdef SIMLIB_PROFILE
+    for(list = 0; list <= MAX_EVENT_TYPE; ++list) {
+        profile_events[list]          = 0;
+        profile_handler_samples[list] = 0;
+        profile_handler_time[list]    = 0.0;
+    }
+    for(list = 0; list <= MAX_LIST; ++list) {
+        profile_files[list]   = 0;
+        profile_removes[list] = 0;
+    }
+    profile_timing_samples   = 0;
+    profile_timing_time      = 0.0;
+    profile_schedules        = 0;
+    profile_schedule_samples = 0;
+    profile_schedule_time    = 0.0;
+    profile_type             = -1;
+#endif
 
     event_alloc_size = sizeof(double) * (maxatr + 1);
+    event_radix = NULL;
+    event_tick  = 0.0;
     event_heap = minheap_construct(event_alloc_size, event_later);
     if (event_heap == NULL) {
         printf("out of memory");
@@ -95,9 +304,27 @@ void init_simlib()
 
 void cleanup_simlib()
 {
-    int list;
+    int list, ivar;
+
+    if(trace_mode != 0) trace_stop();
+
+#ifdef SIMLIB_PROFILE
+    out_profile(stderr);
+#endif
 
     minheap_destroy(event_heap);
+    event_heap = NULL;
+    if(event_radix != NULL) radixheap_destroy(event_radix);
+    event_radix = NULL;
+    event_tick  = 0.0;
+
+    for (ivar = 1; ivar <= MAX_SVAR; ++ivar) {
+        memory_free(sampst_sketch[ivar], MEM_STAT);
+        sampst_sketch[ivar] = NULL;
+    }
+
+    mser_init();
+    series_stop();
 
     for (list = 1; list <= maxlist; ++list) {
         while (head[list] != NULL) {
@@ -105,11 +332,11 @@ void cleanup_simlib()
         }
     }
 
-    free(transfer);
-    free(tail);
-    free(head);
-    free(list_size);
-    free(list_rank);
+    memory_free(transfer, MEM_CORE);
+    memory_free(tail, MEM_CORE);
+    memory_free(head, MEM_CORE);
+    memory_free(list_size, MEM_CORE);
+    memory_free(list_rank, MEM_CORE);
 
     transfer = NULL;
     tail = NULL;
@@ -142,6 +369,11 @@ void list_file(int option, int list)
     /* Increment the list size. */
 
     list_size[list]++;
+    if(list_size[list] > list_peak[list])
+        list_peak[list] = list_size[list];
+#ifdef SIMLIB_PROFILE
+    ++profile_files[list];
+#endif
 
     /* If the option value is improper, stop the simulation. */
 
@@ -156,7 +388,7 @@ void list_file(int option, int list)
 
     if(list_size[list] == 1) {
 
-        row        = (struct master *) malloc(sizeof(struct master));
+        row        = (struct master *) memory_alloc(sizeof(struct master), MEM_LIST);
         head[list] = row ;
         tail[list] = row ;
         row->pr    = NULL;
@@ -221,7 +453,7 @@ void list_file(int option, int list)
 
                     ahead        = behind->sr;
                     row          = (struct master *)
-                                        malloc(sizeof(struct master));
+                                        memory_alloc(sizeof(struct master), MEM_LIST);
                     row->pr      = behind;
                     behind->sr   = row;
                     ahead->pr    = row;
@@ -230,7 +462,7 @@ void list_file(int option, int list)
         } /* End if inserting in increasing or decreasing order. */
 
         if (option == FIRST) {
-            row         = (struct master *) malloc(sizeof(struct master));
+            row         = (struct master *) memory_alloc(sizeof(struct master), MEM_LIST);
             ihead       = head[list];
             ihead->pr   = row;
             row->sr     = ihead;
@@ -238,7 +470,7 @@ void list_file(int option, int list)
             head[list]  = row;
         }
         if (option == LAST) {
-            row         = (struct master *) malloc(sizeof(struct master));
+            row         = (struct master *) memory_alloc(sizeof(struct master), MEM_LIST);
             itail       = tail[list];
             row->pr     = itail;
             itail->sr   = row;
@@ -249,7 +481,7 @@ void list_file(int option, int list)
 
     /* Copy the row values from the transfer array. */
 
-    row->value = calloc(maxatr + 1, sizeof(double));
+    row->value = (double *) memory_alloc((maxatr + 1) * sizeof(double), MEM_LIST);
     memcpy(row->value, transfer, (maxatr + 1) * sizeof(double));
 
     /* Update the area under the number-in-list curve. */
@@ -286,6 +518,9 @@ void list_remove(int option, int list)
     /* Decrement the list size. */
 
     list_size[list]--;
+#ifdef SIMLIB_PROFILE
+    ++profile_removes[list];
+#endif
 
     /* If the option value is improper, stop the simulation. */
 
@@ -335,14 +570,78 @@ void list_remove(int option, int list)
     /* Copy the data and free memory. */
     memcpy(transfer, row->value, sizeof(double) * (maxatr + 1));
 
-    free(row->value);
+    memory_free(row->value, MEM_LIST);
+    row->value = NULL;
+    memory_free(row, MEM_LIST);
+    row = NULL;
+
+    /* Update the area under the number-in-list curve. */
+
+    timest((double)list_size[list], TIM_VAR + list);
+}
+
+
+int list_remove_match(int list, int attribute, double value)
+{
+
+/* Remove the first record in list "list" whose attribute "attribute" equals
+   "value" and copy its attributes into transfer.  Update timest statistics
+   for the list.  Returns 1 if a record was removed, 0 if none matched (in
+   which case transfer is left untouched). */
+
+    struct master *row;
+
+    /* If the list value is improper, stop the simulation. */
+
+    if(!((list >= 0) && (list <= MAX_LIST))) {
+        printf("\nInvalid list %d for list_remove_match at time %f\n",
+               list, sim_time);
+        exit(1);
+    }
+
+    /* If the attribute value is improper, stop the simulation. */
+
+    if(!((attribute >= 1) && (attribute <= maxatr))) {
+        printf(
+            "%d is an improper attribute for list_remove_match on list %d at time %f\n",
+            attribute, list, sim_time);
+        exit(1);
+    }
+
+    /* Search from the head of the list for the matching record. */
+
+    for (row = head[list]; row != NULL; row = row->sr) {
+        if (row->value[attribute] == value) break;
+    }
+
+    if (row == NULL) return 0;
+
+    /* Unlink the record. */
+
+    if (row->pr == NULL) head[list]   = row->sr;
+    else                 row->pr->sr  = row->sr;
+    if (row->sr == NULL) tail[list]   = row->pr;
+    else                 row->sr->pr  = row->pr;
+
+    list_size[list]--;
+#ifdef SIMLIB_PROFILE
+    ++profile_removes[list];
+#endif
+
+    /* Copy the data and free memory. */
+
+    memcpy(transfer, row->value, sizeof(double) * (maxatr + 1));
+
+    memory_free(row->value, MEM_LIST);
     row->value = NULL;
-    free(row);
+    memory_free(row, MEM_LIST);
     row = NULL;
 
     /* Update the area under the number-in-list curve. */
 
     timest((double)list_size[list], TIM_VAR + list);
+
+    return 1;
 }
 
 
@@ -353,16 +652,38 @@ void timing()
    Set sim_time (simulation time) to event time, transfer[1].
    Set next_event_type to this event type, transfer[2]. */
 
+#ifdef SIMLIB_PROFILE
+    double profile_start = 0.0;
+    int    profile_sample;
+
+    /* End the handler time of the previous event if it was sampled, and
+       decide whether to sample this one. */
+
+    profile_sample = ((events_processed + 1) % PROFILE_SAMPLE == 0);
+    if(profile_sample || profile_type >= 0)
+        profile_start = profile_now();
+    if(profile_type >= 0) {
+        profile_handler_time[profile_type] += profile_start - profile_clock;
+        ++profile_handler_samples[profile_type];
+        profile_type = -1;
+    }
+#endif
+
     /* Remove the first event from the event list and put it in transfer[]. */
 
-    if (minheap_empty(event_heap)) {
+    if (event_tick > 0.0 ? radixheap_empty(event_radix) : minheap_empty(event_heap)) {
         printf("\nAttempt to advance simulation with an empty event list at time %f/n",
                sim_time);
         exit(1);
     }
 
-    memcpy(transfer, minheap_minimum(event_heap), event_alloc_size);
-    minheap_delete_minimum(event_heap);
+    if(event_tick > 0.0) {
+        memcpy(transfer, radixheap_minimum(event_radix), event_alloc_size);
+        radixheap_delete_minimum(event_radix);
+    } else {
+        memcpy(transfer, minheap_minimum(event_heap), event_alloc_size);
+        minheap_delete_minimum(event_heap);
+    }
 
     /* Check for a time reversal. */
 
@@ -377,6 +698,128 @@ void timing()
 
     sim_time        = transfer[EVENT_TIME];
     next_event_type = transfer[EVENT_TYPE];
+    ++events_processed;
+    if(trace_mode != 0) trace_event();
+
+#ifdef SIMLIB_PROFILE
+    profile_type = (next_event_type >= 0 && next_event_type <= MAX_EVENT_TYPE)
+                   ? next_event_type : 0;
+    ++profile_events[profile_type];
+    if(profile_sample) {
+        profile_clock = profile_now();
+        profile_timing_time += profile_clock - profile_start;
+        ++profile_timing_samples;
+    } else
+        profile_type = -1;
+#endif
+}
+
+
+int timing_batch(double *events, int max_events)
+{
+
+/* Remove the events at the earliest time in the event list, up to
+   max_events of them, placing their records one after the other in events
+   (maxatr + 1 values each), in the order timing would remove them: the
+   order they were scheduled with event_ticks, heap order otherwise.  Set
+   sim_time to their time, and transfer and next_event_type to the first of
+   them.  Return the number of events removed, which are all added to
+   events_processed; a caller that stops before handling some of them takes
+   those back off it.  Events the model schedules for the same time while
+   handling them come in the next batch.  While a
+   trace is on, the batch is a single event, traced as timing does; under
+   SIMLIB_PROFILE, batched events are counted but not timed. */
+
+    size_t width = maxatr + 1;
+    int    count;
+
+    if(max_events < 1) {
+        printf("\n%d is an improper number of events for timing_batch at time %f\n",
+            max_events, sim_time);
+        exit(1);
+    }
+    if(trace_mode != 0) {
+        timing();
+        memcpy(events, transfer, event_alloc_size);
+        return 1;
+    }
+
+    if (event_tick > 0.0 ? radixheap_empty(event_radix) : minheap_empty(event_heap)) {
+        printf("\nAttempt to advance simulation with an empty event list at time %f/n",
+               sim_time);
+        exit(1);
+    }
+
+    /* The radix heap hands over its bucket of the minimum tick at once.  The
+       binary heap is emptied of its minimum time one event at a time. */
+
+    if(event_tick > 0.0)
+        count = (int) radixheap_delete_minimums(event_radix, events, (size_t) max_events);
+    else {
+        count = 0;
+        do {
+            memcpy(events + count * width, minheap_minimum(event_heap), event_alloc_size);
+            minheap_delete_minimum(event_heap);
+            ++count;
+        } while(count < max_events && !minheap_empty(event_heap) &&
+                ((double *) minheap_minimum(event_heap))[EVENT_TIME] == events[EVENT_TIME]);
+    }
+
+    /* Check for a time reversal. */
+
+    if(events[EVENT_TIME] < sim_time) {
+        printf(
+            "\nAttempt to schedule event type %f for time %f at time %f\n",
+            events[EVENT_TYPE], events[EVENT_TIME], sim_time);
+        exit(1);
+    }
+
+    /* Advance the simulation clock and set the first event. */
+
+    sim_time = events[EVENT_TIME];
+    memcpy(transfer, events, event_alloc_size);
+    next_event_type   = transfer[EVENT_TYPE];
+    events_processed += count;
+
+#ifdef SIMLIB_PROFILE
+    {
+        int ievent, type;
+
+        for(ievent = 0; ievent < count; ++ievent) {
+            type = (int) events[ievent * width + EVENT_TYPE];
+            ++profile_events[(type >= 0 && type <= MAX_EVENT_TYPE) ? type : 0];
+        }
+        profile_type = -1;
+    }
+#endif
+
+    return count;
+}
+
+
+void event_ticks(double tick)
+{
+
+/* Keep the event list on integer ticks of length tick, in a radix heap,
+   instead of on double times in the minheap (tick 0 goes back to the
+   minheap).  Every event time must then be a whole number of ticks, and
+   events at the same time are removed in the order they were scheduled.
+   Call after init_simlib, with the event list empty. */
+
+    if(event_count() > 0) {
+        printf("\nThe event list must be empty to change its ticks at time %f\n",
+            sim_time);
+        exit(1);
+    }
+    if(event_radix != NULL) event_radix_destroy();
+    event_tick = (tick > 0.0) ? tick : 0.0;
+    if(event_tick > 0.0) {
+        event_radix = radixheap_construct(event_alloc_size);
+        if(event_radix == NULL) {
+            printf("out of memory");
+            exit(1);
+        }
+    }
 }
 
 
@@ -388,11 +831,82 @@ void event_schedule(double time_of_event, int type_of_event)
    being used in the event list, it is the user's responsibility to place their
    values into the transfer array before invoking event_schedule. */
 
+#ifdef SIMLIB_PROFILE
+    double profile_start = 0.0;
+    int    profile_sample;
+
+    profile_sample = (++profile_schedules % PROFILE_SAMPLE == 0);
+    if(profile_sample)
+        profile_start = profile_now();
+#endif
+
+    /* The radix heap takes no times before the last one removed. */
+
+    if(event_tick > 0.0 && time_of_event < sim_time) {
+        printf("\nAttempt to schedule event type %d for time %f at time %f\n",
+            type_of_event, time_of_event, sim_time);
+        exit(1);
+    }
+
     transfer[EVENT_TIME] = time_of_event;
     transfer[EVENT_TYPE] = type_of_event;
-    minheap_insert(event_heap, transfer);
+    event_insert(transfer);
+    if((long) event_count() > event_list_peak)
+        event_list_peak = (long) event_count();
+
+#ifdef SIMLIB_PROFILE
+    if(profile_sample) {
+        profile_schedule_time += profile_now() - profile_start;
+        ++profile_schedule_samples;
+    }
+#endif
+}
+
+static int sketch_bin(double magnitude)
+{
+
+/* Return the sketch bin of a magnitude of at least SKETCH_MIN.  Bin k holds
+   (SKETCH_MIN * gamma^(k-1), SKETCH_MIN * gamma^k] with
+   gamma = (1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA); magnitudes past the last
+   bin are kept in it. */
+
+    static double log_gamma = 0.0;
+    int bin;
+
+    if(log_gamma == 0.0)
+        log_gamma = log((1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA));
+
+    bin = (int) ceil(log(magnitude / SKETCH_MIN) / log_gamma);
+    if(bin < 0) bin = 0;
+    if(bin >= SKETCH_BINS) bin = SKETCH_BINS - 1;
+    return bin;
+}
+
+
+static double sketch_value(int bin)
+{
+
+/* Return the value representing sketch bin "bin", which is within
+   SKETCH_ALPHA (relative) of every magnitude in the bin. */
+
+    double gamma = (1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA);
+
+    return 2.0 * SKETCH_MIN * pow(gamma, bin) / (gamma + 1.0);
+}
+
+
+static void sketch_add(struct quantile_sketch *sketch, double value)
+{
+    sketch->count++;
+    if(value >= SKETCH_MIN)
+        sketch->positive[sketch_bin(value)]++;
+    else if(value <= -SKETCH_MIN)
+        sketch->negative[sketch_bin(-value)]++;
+    else
+        sketch->zero_count++;
 }
 
+
 double sampst(double value, int variable)
 {
 
@@ -405,10 +919,13 @@ double sampst(double value, int variable)
            [1] = average of observations
            [2] = number of observations
            [3] = maximum of observations
-           [4] = minimum of observations */
+           [4] = minimum of observations
+   The running mean and sum of squared deviations are kept with Welford's
+   method; see sampst_variance. */
 
-    static int   ivar, num_observations[SVAR_SIZE];
-    static double max[SVAR_SIZE], min[SVAR_SIZE], sum[SVAR_SIZE];
+    int    ivar;
+    double delta;
+    struct sampst_accumulator *acc;
     double default_return = 0.0;
 
     /* If the variable value is improper, stop the simulation. */
@@ -422,29 +939,40 @@ double sampst(double value, int variable)
     /* Execute the desired option. */
 
     if(variable > 0) { /* Update. */
-        sum[variable] += value;
-        if(value > max[variable]) max[variable] = value;
-        if(value < min[variable]) min[variable] = value;
-        num_observations[variable]++;
+        acc = &sampst_acc[variable];
+        acc->sum += value;
+        if(value > acc->max) acc->max = value;
+        if(value < acc->min) acc->min = value;
+        acc->num_observations++;
+        delta      = value - acc->mean;
+        acc->mean += delta / acc->num_observations;
+        acc->m2   += delta * (value - acc->mean);
+        if(sampst_sketch[variable] != NULL)
+            sketch_add(sampst_sketch[variable], value);
     } else if(variable < 0) { /* Report summary statistics in transfer. */
-        ivar        = -variable;
-        transfer[2] = (double) num_observations[ivar];
-        transfer[3] = max[ivar];
-        transfer[4] = min[ivar];
-        if(num_observations[ivar] == 0)
+        acc         = &sampst_acc[-variable];
+        transfer[2] = (double) acc->num_observations;
+        transfer[3] = acc->max;
+        transfer[4] = acc->min;
+        if(acc->num_observations == 0)
             transfer[1] = 0.0;
         else
-            transfer[1] = sum[ivar] / transfer[2];
+            transfer[1] = acc->sum / transfer[2];
         return transfer[1];
     } else {
 
         /* Initialize the accumulators. */
 
         for(ivar=1; ivar <= MAX_SVAR; ++ivar) {
-            sum[ivar]              = 0.0;
-            max[ivar]              = -INFINITY;
-            min[ivar]              =  INFINITY;
-            num_observations[ivar] = 0;
+            acc                   = &sampst_acc[ivar];
+            acc->num_observations = 0;
+            acc->sum              = 0.0;
+            acc->max              = -INFINITY;
+            acc->min              =  INFINITY;
+            acc->mean             = 0.0;
+            acc->m2               = 0.0;
+            if(sampst_sketch[ivar] != NULL)
+                memset(sampst_sketch[ivar], 0, sizeof(struct quantile_sketch));
         }
     }
 
@@ -452,6 +980,176 @@ double sampst(double value, int variable)
 }
 
 
+double sampst_variance(int variable)
+{
+
+/* Return the sample variance (divisor n - 1) of the observations of sampst
+   variable "variable", or 0 if there are fewer than two.  The standard error
+   of the average, assuming independent observations, is
+   sqrt(sampst_variance(variable) / n). */
+
+    struct sampst_accumulator *acc = &sampst_acc[variable];
+
+    if(acc->num_observations < 2) return 0.0;
+    return acc->m2 / (acc->num_observations - 1);
+}
+
+
+void sampst_get(int variable, struct sampst_accumulator *acc)
+{
+
+/* Copy the accumulators of sampst variable "variable" into *acc, e.g. to
+   write them to a file or pipe at the end of a replication. */
+
+    *acc = sampst_acc[variable];
+}
+
+
+void sampst_set(int variable, const struct sampst_accumulator *acc)
+{
+
+/* Replace the accumulators of sampst variable "variable" by *acc. */
+
+    sampst_acc[variable] = *acc;
+}
+
+
+void sampst_merge(int variable, const struct sampst_accumulator *acc)
+{
+
+/* Pool the observations summarized in *acc (e.g. from another replication or
+   worker) into sampst variable "variable".  The result is the same as if all
+   observations had been passed to sampst on this variable, up to rounding. */
+
+    struct sampst_accumulator *into = &sampst_acc[variable];
+    long   n;
+    double delta;
+
+    if(acc->num_observations == 0) return;
+    if(into->num_observations == 0) {
+        *into = *acc;
+        return;
+    }
+
+    n           = into->num_observations + acc->num_observations;
+    delta       = acc->mean - into->mean;
+    into->m2   += acc->m2 + delta * delta *
+                  ((double) into->num_observations * acc->num_observations / n);
+    into->mean += delta * acc->num_observations / n;
+    into->sum  += acc->sum;
+    if(acc->max > into->max) into->max = acc->max;
+    if(acc->min < into->min) into->min = acc->min;
+    into->num_observations = n;
+}
+
+
+void sampst_quantiles(int variable)
+{
+
+/* Keep a quantile sketch for sampst variable "variable" from now on, so that
+   sampst_quantile can report on it and out_sampst prints its quantiles.  The
+   sketch is cleared with the other accumulators and released by
+   cleanup_simlib. */
+
+    if(!((variable >= 1) && (variable <= MAX_SVAR))) {
+        printf("\n%d is an improper value for a sampst variable at time %f\n",
+            variable, sim_time);
+        exit(1);
+    }
+
+    if(sampst_sketch[variable] != NULL) return;
+
+    sampst_sketch[variable] = (struct quantile_sketch *)
+        memory_alloc(sizeof(struct quantile_sketch), MEM_STAT);
+}
+
+
+double sampst_quantile(int variable, double q)
+{
+
+/* Return the q-quantile (0 <= q <= 1) of the observations of sampst variable
+   "variable", to within relative accuracy SKETCH_ALPHA.  Returns 0 if the
+   variable has no sketch or no observations. */
+
+    struct quantile_sketch *sketch = sampst_sketch[variable];
+    double rank, seen;
+    int    bin;
+
+    if(sketch == NULL || sketch->count == 0) return 0.0;
+
+    rank = floor(q * (sketch->count - 1));
+    seen = 0.0;
+
+    for(bin = SKETCH_BINS - 1; bin >= 0; --bin) {
+        seen += sketch->negative[bin];
+        if(seen > rank) return -sketch_value(bin);
+    }
+    seen += sketch->zero_count;
+    if(seen > rank) return 0.0;
+    for(bin = 0; bin < SKETCH_BINS; ++bin) {
+        seen += sketch->positive[bin];
+        if(seen > rank) return sketch_value(bin);
+    }
+    return sketch_value(SKETCH_BINS - 1);
+}
+
+
+void sampst_sketch_get(int variable, struct quantile_sketch *sketch)
+{
+
+/* Copy the quantile sketch of sampst variable "variable" into *sketch (all
+   zero if it has none). */
+
+    if(sampst_sketch[variable] == NULL)
+        memset(sketch, 0, sizeof(struct quantile_sketch));
+    else
+        *sketch = *sampst_sketch[variable];
+}
+
+
+void sampst_sketch_merge(int variable, const struct quantile_sketch *sketch)
+{
+
+/* Pool *sketch (e.g. from another replication) into the quantile sketch of
+   sampst variable "variable", which is created if needed. */
+
+    struct quantile_sketch *into;
+    int bin;
+
+    sampst_quantiles(variable);
+    into = sampst_sketch[variable];
+
+    into->count      += sketch->count;
+    into->zero_count += sketch->zero_count;
+    for(bin = 0; bin < SKETCH_BINS; ++bin) {
+        into->positive[bin] += sketch->positive[bin];
+        into->negative[bin] += sketch->negative[bin];
+    }
+}
+
+
+static void timest_advance(int variable)
+{
+
+/* Bring the area and the time-weighted mean and variance accumulators of
+   timest variable "variable" up to the current simulation time. */
+
+    struct timest_accumulator *acc = &timest_acc[variable];
+    double width, delta, shift;
+
+    width = sim_time - acc->tlvc;
+    if(width > 0.0) {
+        acc->area     += width * acc->preval;
+        acc->duration += width;
+        delta          = acc->preval - acc->mean;
+        shift          = delta * width / acc->duration;
+        acc->mean     += shift;
+        acc->m2       += (acc->duration - width) * delta * shift;
+    }
+    acc->tlvc = sim_time;
+}
+
+
 double timest(double value, int variable)
 {
 
@@ -465,11 +1163,11 @@ double timest(double value, int variable)
            [2] = maximum value variable has attained
            [3] = minimum value variable has attained
    Note that variables TIM_VAR + 1 through TVAR_SIZE are used for automatic
-   record keeping on the length of lists 1 through MAX_LIST. */
+   record keeping on the length of lists 1 through MAX_LIST.  The time-weighted
+   variance is kept alongside; see timest_variance. */
 
     int          ivar;
-    static double area[TVAR_SIZE], max[TVAR_SIZE], min[TVAR_SIZE],
-                 preval[TVAR_SIZE], tlvc[TVAR_SIZE], treset;
+    struct timest_accumulator *acc;
     double default_return = 0.0;
 
     /* If the variable value is improper, stop the simulation. */
@@ -483,55 +1181,688 @@ double timest(double value, int variable)
     /* Execute the desired option. */
 
     if(variable > 0) { /* Update. */
-        area[variable] += (sim_time - tlvc[variable]) * preval[variable];
-        if(value > max[variable]) max[variable] = value;
-        if(value < min[variable]) min[variable] = value;
-        preval[variable] = value;
-        tlvc[variable]   = sim_time;
+        acc = &timest_acc[variable];
+        timest_advance(variable);
+        if(value > acc->max) acc->max = value;
+        if(value < acc->min) acc->min = value;
+        acc->preval = value;
     } else if(variable < 0) { /* Report summary statistics in transfer. */
         ivar         = -variable;
-        area[ivar]   += (sim_time - tlvc[ivar]) * preval[ivar];
-        tlvc[ivar]   = sim_time;
-        transfer[1]  = area[ivar] / (sim_time - treset);
-        transfer[2]  = max[ivar];
-        transfer[3]  = min[ivar];
+        acc          = &timest_acc[ivar];
+        timest_advance(ivar);
+        transfer[1]  = acc->area / acc->duration;
+        transfer[2]  = acc->max;
+        transfer[3]  = acc->min;
         return transfer[1];
     } else {
 
         /* Initialize the accumulators. */
 
         for(ivar = 1; ivar <= MAX_TVAR; ++ivar) {
-            area[ivar]   = 0.0;
-            max[ivar]    = -INFINITY;
-            min[ivar]    =  INFINITY;
-            preval[ivar] = 0.0;
-            tlvc[ivar]   = sim_time;
+            acc           = &timest_acc[ivar];
+            acc->area     = 0.0;
+            acc->max      = -INFINITY;
+            acc->min      =  INFINITY;
+            acc->preval   = 0.0;
+            acc->tlvc     = sim_time;
+            acc->duration = 0.0;
+            acc->mean     = 0.0;
+            acc->m2       = 0.0;
         }
-        treset = sim_time;
     }
 
     return default_return;
 }
 
 
-double filest(int list)
+double timest_variance(int variable)
 {
 
-/* Report statistics on the length of list "list" in transfer:
-       [1] = time-average of list length updated to the time of this call
-       [2] = maximum length list has attained
-       [3] = minimum length list has attained
-   This uses timest variable TIM_VAR + list. */
+/* Return the time-weighted variance of timest variable "variable" up to the
+   time of this call. */
 
-    return timest(0.0, -(TIM_VAR + list));
+    struct timest_accumulator *acc = &timest_acc[variable];
+
+    timest_advance(variable);
+    if(acc->duration <= 0.0) return 0.0;
+    return acc->m2 / acc->duration;
 }
 
 
-void out_sampst(FILE *unit, int lowvar, int highvar)
+void timest_get(int variable, struct timest_accumulator *acc)
 {
 
-/* Write sampst statistics for variables lowvar through highvar on file
-   "unit". */
+/* Copy the accumulators of timest variable "variable", brought up to the
+   current simulation time, into *acc. */
+
+    timest_advance(variable);
+    *acc = timest_acc[variable];
+}
+
+
+void timest_set(int variable, const struct timest_accumulator *acc)
+{
+
+/* Replace the accumulators of timest variable "variable" by *acc. */
+
+    timest_acc[variable] = *acc;
+}
+
+
+void timest_merge(int variable, const struct timest_accumulator *acc)
+{
+
+/* Pool the time summarized in *acc (e.g. from another replication) into
+   timest variable "variable".  Areas and durations add, so the reported
+   time-average becomes the average over the pooled time.  The current level
+   and time of last change of the variable are left alone. */
+
+    struct timest_accumulator *into = &timest_acc[variable];
+    double duration, delta;
+
+    timest_advance(variable);
+    if(acc->max > into->max) into->max = acc->max;
+    if(acc->min < into->min) into->min = acc->min;
+    if(acc->duration <= 0.0) return;
+
+    duration    = into->duration + acc->duration;
+    delta       = acc->mean - into->mean;
+    into->m2   += acc->m2 + delta * delta * (into->duration * acc->duration / duration);
+    into->mean += delta * acc->duration / duration;
+    into->area += acc->area;
+    into->duration = duration;
+}
+
+
+void timest_restart(void)
+{
+
+/* Restart every timest variable (including the list lengths) at the current
+   time: area, max and min start over while each variable keeps its current
+   level.  Used to discard a warm-up period. */
+
+    int ivar;
+    struct timest_accumulator *acc;
+
+    for(ivar = 1; ivar <= MAX_TVAR; ++ivar) {
+        acc           = &timest_acc[ivar];
+        acc->area     = 0.0;
+        acc->max      = acc->preval;
+        acc->min      = acc->preval;
+        acc->tlvc     = sim_time;
+        acc->duration = 0.0;
+        acc->mean     = 0.0;
+        acc->m2       = 0.0;
+    }
+}
+
+
+double batchst(double value, int variable)
+{
+
+/* Initialize, update, or report batch-means confidence intervals on
+   discrete-time processes for batchst variable "variable", where "variable":
+       = 0 initializes accumulators
+       > 0 adds a new observation
+       < 0 reports on variable "variable" and returns in transfer:
+           [1] = mean of the observations in complete batches
+           [2] = half-width of the 95% confidence interval for the mean
+           [3] = number of complete batches
+           [4] = number of observations per batch
+   Batches start with one observation.  When BATCH_SLOTS batches are full,
+   adjacent pairs are averaged and the batch size doubles, so the batches
+   keep growing with the run length and their means become nearly
+   independent. */
+
+    int    ivar, ibatch;
+    double mean, sumsq;
+    double default_return = 0.0;
+
+    /* If the variable value is improper, stop the simulation. */
+
+    if(!((variable >= -MAX_BVAR) && (variable <= MAX_BVAR))) {
+        printf("\n%d is an improper value for a batchst variable at time %f\n",
+            variable, sim_time);
+        exit(1);
+    }
+
+    /* Execute the desired option. */
+
+    if(variable > 0) { /* Update. */
+        batch_sum[variable] += value;
+        if(++batch_fill[variable] < batch_size[variable]) return default_return;
+
+        /* The batch is complete.  Store it, collapsing pairs if full. */
+
+        if(batch_count[variable] == BATCH_SLOTS) {
+            for(ibatch = 0; ibatch < BATCH_SLOTS / 2; ++ibatch)
+                batch_mean[variable][ibatch] =
+                    (batch_mean[variable][2 * ibatch] +
+                     batch_mean[variable][2 * ibatch + 1]) / 2.0;
+            batch_count[variable] = BATCH_SLOTS / 2;
+            batch_size[variable] *= 2;
+            if(batch_fill[variable] < batch_size[variable]) return default_return;
+        }
+        batch_mean[variable][batch_count[variable]++] =
+            batch_sum[variable] / batch_size[variable];
+        batch_sum[variable]  = 0.0;
+        batch_fill[variable] = 0;
+    } else if(variable < 0) { /* Report summary statistics in transfer. */
+        ivar  = -variable;
+        mean  = 0.0;
+        sumsq = 0.0;
+        for(ibatch = 0; ibatch < batch_count[ivar]; ++ibatch)
+            mean += batch_mean[ivar][ibatch];
+        if(batch_count[ivar] > 0) mean /= batch_count[ivar];
+        for(ibatch = 0; ibatch < batch_count[ivar]; ++ibatch)
+            sumsq += (batch_mean[ivar][ibatch] - mean) *
+                     (batch_mean[ivar][ibatch] - mean);
+        transfer[1] = mean;
+        if(batch_count[ivar] < 2)
+            transfer[2] = INFINITY;
+        else
+            transfer[2] = t_quantile(batch_count[ivar] - 1) *
+                          sqrt(sumsq / (batch_count[ivar] - 1) / batch_count[ivar]);
+        transfer[3] = batch_count[ivar];
+        transfer[4] = batch_size[ivar];
+        return transfer[1];
+    } else {
+
+        /* Initialize the accumulators. */
+
+        for(ivar = 1; ivar <= MAX_BVAR; ++ivar) {
+            batch_sum[ivar]   = 0.0;
+            batch_size[ivar]  = 1;
+            batch_fill[ivar]  = 0;
+            batch_count[ivar] = 0;
+        }
+    }
+
+    return default_return;
+}
+
+
+double pairst(double value, int variable)
+{
+
+/* Initialize, update, or report statistics of antithetic pairs of runs for
+   pairst variable "variable", where "variable":
+       = 0 initializes accumulators
+       > 0 adds the estimate of the next run; runs alternate between the
+           first member of a pair and its antithetic partner
+       < 0 reports on variable "variable" and returns in transfer:
+           [1] = mean of the pair averages
+           [2] = variance of the pair averages
+           [3] = number of complete pairs
+           [4] = variance the average of two independent runs would have
+   [2] / [4] is the variance reduction, 1 plus the correlation of the two
+   members; the variances are 0 before there are two pairs.  Unlike the
+   other statistics, pairst is not initialized by init_simlib, since the
+   members of a pair are separate runs. */
+
+    int    ivar, member;
+    double average, delta, n;
+    double default_return = 0.0;
+
+    /* If the variable value is improper, stop the simulation. */
+
+    if(!((variable >= -MAX_PVAR) && (variable <= MAX_PVAR))) {
+        printf("\n%d is an improper value for a pairst variable at time %f\n",
+            variable, sim_time);
+        exit(1);
+    }
+
+    /* Execute the desired option. */
+
+    if(variable > 0) { /* Update. */
+        if(!pair_pending[variable]) {
+            pair_first[variable]   = value;
+            pair_pending[variable] = 1;
+            return default_return;
+        }
+        pair_pending[variable] = 0;
+        n = (double) ++pair_count[variable];
+
+        average = (pair_first[variable] + value) / 2.0;
+        delta   = average - pair_mean[variable];
+        pair_mean[variable] += delta / n;
+        pair_m2[variable]   += delta * (average - pair_mean[variable]);
+
+        for(member = 0; member <= 1; ++member) {
+            average = (member == 0) ? pair_first[variable] : value;
+            delta   = average - member_mean[variable][member];
+            member_mean[variable][member] += delta / n;
+            member_m2[variable][member]   +=
+                delta * (average - member_mean[variable][member]);
+        }
+    } else if(variable < 0) { /* Report summary statistics in transfer. */
+        ivar = -variable;
+        transfer[1] = pair_mean[ivar];
+        transfer[2] = 0.0;
+        transfer[4] = 0.0;
+        if(pair_count[ivar] >= 2) {
+            transfer[2] = pair_m2[ivar] / (pair_count[ivar] - 1);
+            transfer[4] = (member_m2[ivar][0] + member_m2[ivar][1]) /
+                          (pair_count[ivar] - 1) / 4.0;
+        }
+        transfer[3] = pair_count[ivar];
+        return transfer[1];
+    } else {
+
+        /* Initialize the accumulators. */
+
+        for(ivar = 1; ivar <= MAX_PVAR; ++ivar) {
+            pair_pending[ivar]   = 0;
+            pair_count[ivar]     = 0;
+            pair_mean[ivar]      = 0.0;
+            pair_m2[ivar]        = 0.0;
+            for(member = 0; member <= 1; ++member) {
+                member_mean[ivar][member] = 0.0;
+                member_m2[ivar][member]   = 0.0;
+            }
+        }
+    }
+
+    return default_return;
+}
+
+
+double cvst(double value, const double *controls, int variable)
+{
+
+/* Initialize, update, or report control-variate estimates for cvst variable
+   "variable", where "variable":
+       = 0 initializes accumulators
+       > 0 adds an observation "value" of the output (e.g. a batch mean)
+           with the matching observations controls[0..MAX_CONTROL-1] of
+           inputs whose means are known
+       < 0 reports on variable "variable", with the known means of the
+           controls in controls[0..MAX_CONTROL-1], and returns in transfer:
+           [1] = mean of the observations
+           [2] = standard error of [1]
+           [3] = mean adjusted by regression on the controls
+           [4] = standard error of [3]
+   The adjusted mean is  mean(y) - b'(mean(c) - mu)  with b the least-squares
+   coefficients of y on the controls c, and its standard error is
+   s sqrt(1/n + (mean(c) - mu)' S^-1 (mean(c) - mu)),  S the centered cross
+   products of the controls and s the residual standard deviation.
+   Controls that do not vary (e.g. an unused one passed as 0) are left out.
+   Standard errors are INFINITY with too few observations. */
+
+    int    ivar, j, k, used[MAX_CONTROL], q;
+    double n, mean_y, s_yy, s_cy[MAX_CONTROL], s_cc[MAX_CONTROL][MAX_CONTROL];
+    double d[MAX_CONTROL], b[MAX_CONTROL], det, rss, quad;
+    double default_return = 0.0;
+
+    /* If the variable value is improper, stop the simulation. */
+
+    if(!((variable >= -MAX_CVAR) && (variable <= MAX_CVAR))) {
+        printf("\n%d is an improper value for a cvst variable at time %f\n",
+            variable, sim_time);
+        exit(1);
+    }
+
+    /* Execute the desired option. */
+
+    if(variable > 0) { /* Update. */
+        if(cv_count[variable] == 0) {
+            cv_shift_y[variable] = value;
+            for(j = 0; j < MAX_CONTROL; ++j)
+                cv_shift_c[variable][j] = controls[j];
+        }
+        ++cv_count[variable];
+        value -= cv_shift_y[variable];
+        cv_sum_y[variable]  += value;
+        cv_sum_yy[variable] += value * value;
+        for(j = 0; j < MAX_CONTROL; ++j) {
+            d[j] = controls[j] - cv_shift_c[variable][j];
+            cv_sum_c[variable][j]  += d[j];
+            cv_sum_yc[variable][j] += value * d[j];
+        }
+        for(j = 0; j < MAX_CONTROL; ++j)
+            for(k = 0; k < MAX_CONTROL; ++k)
+                cv_sum_cc[variable][j][k] += d[j] * d[k];
+    } else if(variable < 0) { /* Report summary statistics in transfer. */
+        ivar = -variable;
+        n    = (double) cv_count[ivar];
+        transfer[1] = cv_shift_y[ivar];
+        transfer[2] = INFINITY;
+        transfer[3] = cv_shift_y[ivar];
+        transfer[4] = INFINITY;
+        if(n < 1) return transfer[1];
+
+        /* Centered sums of squares and cross products. */
+
+        mean_y = cv_sum_y[ivar] / n;
+        s_yy   = cv_sum_yy[ivar] - n * mean_y * mean_y;
+        for(j = 0; j < MAX_CONTROL; ++j) {
+            s_cy[j] = cv_sum_yc[ivar][j] - cv_sum_c[ivar][j] * mean_y;
+            d[j]    = cv_sum_c[ivar][j] / n + cv_shift_c[ivar][j] - controls[j];
+            for(k = 0; k < MAX_CONTROL; ++k)
+                s_cc[j][k] = cv_sum_cc[ivar][j][k] -
+                             cv_sum_c[ivar][j] * cv_sum_c[ivar][k] / n;
+        }
+        transfer[1] = mean_y + cv_shift_y[ivar];
+        if(n >= 2) transfer[2] = sqrt(s_yy / (n - 1) / n);
+
+        /* Solve for the coefficients of the controls that vary. */
+
+        q = 0;
+        for(j = 0; j < MAX_CONTROL; ++j) {
+            used[j] = (s_cc[j][j] > 1.E-12 * (1.0 + fabs(cv_sum_cc[ivar][j][j])));
+            b[j]    = 0.0;
+            if(used[j]) ++q;
+        }
+        if(q == 2) {
+            det = s_cc[0][0] * s_cc[1][1] - s_cc[0][1] * s_cc[1][0];
+            if(fabs(det) <= 1.E-12 * s_cc[0][0] * s_cc[1][1]) {
+                used[1] = 0; /* Collinear controls; keep the first. */
+                q = 1;
+            }
+            else {
+                b[0] = ( s_cc[1][1] * s_cy[0] - s_cc[0][1] * s_cy[1]) / det;
+                b[1] = (-s_cc[1][0] * s_cy[0] + s_cc[0][0] * s_cy[1]) / det;
+            }
+        }
+        if(q == 1)
+            for(j = 0; j < MAX_CONTROL; ++j)
+                if(used[j]) b[j] = s_cy[j] / s_cc[j][j];
+
+        /* Adjusted mean and its standard error. */
+
+        transfer[3] = transfer[1];
+        rss  = s_yy;
+        quad = 0.0;
+        for(j = 0; j < MAX_CONTROL; ++j) {
+            if(!used[j]) continue;
+            transfer[3] -= b[j] * d[j];
+            rss         -= b[j] * s_cy[j];
+        }
+        if(q == 1)
+            for(j = 0; j < MAX_CONTROL; ++j)
+                if(used[j]) quad = d[j] * d[j] / s_cc[j][j];
+        if(q == 2)
+            quad = (s_cc[1][1] * d[0] * d[0] - 2.0 * s_cc[0][1] * d[0] * d[1] +
+                    s_cc[0][0] * d[1] * d[1]) / det;
+        if(n > q + 1) {
+            if(rss < 0.0) rss = 0.0;
+            transfer[4] = sqrt(rss / (n - 1 - q) * (1.0 / n + quad));
+        }
+        return transfer[3];
+    } else {
+
+        /* Initialize the accumulators. */
+
+        for(ivar = 1; ivar <= MAX_CVAR; ++ivar) {
+            cv_count[ivar]  = 0;
+            cv_sum_y[ivar]  = 0.0;
+            cv_sum_yy[ivar] = 0.0;
+            for(j = 0; j < MAX_CONTROL; ++j) {
+                cv_sum_c[ivar][j]  = 0.0;
+                cv_sum_yc[ivar][j] = 0.0;
+                for(k = 0; k < MAX_CONTROL; ++k)
+                    cv_sum_cc[ivar][j][k] = 0.0;
+            }
+        }
+    }
+
+    return default_return;
+}
+
+
+double t_quantile(int dof)
+{
+
+/* Return the Student t quantile with "dof" degrees of freedom matching the
+   normal quantile BATCH_Z (Cornish-Fisher expansion; within 0.2% for 5 or
+   more degrees of freedom). */
+
+    double z = BATCH_Z, z2 = BATCH_Z * BATCH_Z;
+
+    return z + z * (z2 + 1.0) / (4.0 * dof)
+             + z * ((5.0 * z2 + 16.0) * z2 + 3.0) / (96.0 * dof * dof)
+             + z * (((3.0 * z2 + 19.0) * z2 + 17.0) * z2 - 15.0)
+               / (384.0 * dof * dof * dof);
+}
+
+
+double filest(int list)
+{
+
+/* Report statistics on the length of list "list" in transfer:
+       [1] = time-average of list length updated to the time of this call
+       [2] = maximum length list has attained
+       [3] = minimum length list has attained
+   This uses timest variable TIM_VAR + list. */
+
+    return timest(0.0, -(TIM_VAR + list));
+}
+
+
+void mser_init(void)
+{
+
+/* Start (or restart) MSER-5 warm-up detection. */
+
+    memory_free(mser_means, MEM_STAT);
+    mser_means     = NULL;
+    mser_count     = 0;
+    mser_alloc     = 0;
+    mser_point     = -1;
+    mser_in_batch  = 0;
+    mser_batch_sum = 0.0;
+}
+
+
+static long mser_minimize(void)
+{
+
+/* Return the number of leading batch means d that minimizes the MSER
+   statistic  sum_{j>d} (Z_j - mean_{j>d} Z)^2 / (n - d)^2, computed from
+   suffix sums in one backward pass. */
+
+    long   d, best;
+    double sum, sumsq, m, stat, best_stat;
+
+    sum       = 0.0;
+    sumsq     = 0.0;
+    best      = mser_count - 1;
+    best_stat = INFINITY;
+
+    for(d = mser_count - 1; d >= 0; --d) {
+        sum   += mser_means[d];
+        sumsq += mser_means[d] * mser_means[d];
+        m      = mser_count - d;
+        if(m < 2) continue;
+        stat   = (sumsq - sum * sum / m) / (m * m);
+        if(stat <= best_stat) {
+            best_stat = stat;
+            best      = d;
+        }
+    }
+    return best;
+}
+
+
+int mser_observe(double value)
+{
+
+/* Feed the next observation of the output process (e.g. a customer's wait)
+   to the MSER-5 warm-up detector.  Observations are averaged in batches of
+   MSER_BATCH; every MSER_CHECK batches the truncation point minimizing the
+   MSER statistic is found, and it is accepted once it lies in the first half
+   of the batches seen.  Returns 1 from then on, 0 before. */
+
+    double *grown;
+
+    if(mser_point >= 0) return 1;
+
+    mser_batch_sum += value;
+    if(++mser_in_batch < MSER_BATCH) return 0;
+
+    /* Store the batch mean, growing the array as needed. */
+
+    if(mser_count == mser_alloc) {
+        mser_alloc = (mser_alloc == 0) ? 1024 : 2 * mser_alloc;
+        grown = (double *) realloc(mser_means, mser_alloc * sizeof(double));
+        if(grown == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        if(mser_means != NULL) ++memory_frees[MEM_STAT];
+        ++memory_allocs[MEM_STAT];
+        mser_means = grown;
+    }
+    mser_means[mser_count++] = mser_batch_sum / MSER_BATCH;
+    mser_in_batch  = 0;
+    mser_batch_sum = 0.0;
+
+    if(mser_count % MSER_CHECK != 0) return 0;
+
+    /* Check for a truncation point in the first half of the data. */
+
+    mser_point = mser_minimize();
+    if(2 * mser_point > mser_count) {
+        mser_point = -1;
+        return 0;
+    }
+    return 1;
+}
+
+
+long mser_truncation(void)
+{
+
+/* Return the MSER-5 truncation point in observations, or -1 if none has been
+   found yet. */
+
+    return (mser_point < 0) ? -1 : mser_point * MSER_BATCH;
+}
+
+
+double timest_level(int variable)
+{
+
+/* Return the current level of timest variable "variable" (TIM_VAR + list for
+   the length of a list). */
+
+    if(variable < 1 || variable > MAX_TVAR) {
+        printf("\n%d is an improper value for a timest variable at time %f\n",
+            variable, sim_time);
+        exit(1);
+    }
+    return timest_acc[variable].preval;
+}
+
+
+void series_start(double interval, int columns, long rows)
+{
+
+/* Start a time series of columns values (at most MAX_SERIES), sampled every
+   interval from the current time on, with room for rows samples.  All the
+   memory is allocated here, so sampling never allocates. */
+
+    series_stop();
+    if(columns < 1 || columns > MAX_SERIES || rows < 1 || interval <= 0.0) {
+        printf("\nImproper time series of %d columns, %ld rows and interval %f\n",
+            columns, rows, interval);
+        exit(1);
+    }
+    series_values   = (double *) memory_alloc((columns + 1) * rows * sizeof(double), MEM_STAT);
+    series_alloc    = rows;
+    series_columns  = columns;
+    series_interval = interval;
+    series_time     = sim_time;
+}
+
+
+int series_due(void)
+{
+
+/* Return 1 if a sample is due at or before the current time, for a model to
+   call after timing.  The sample is then of the state just before the event
+   timing removed, which is the state at the sample time.  Samples due once
+   the series is full are dropped and counted. */
+
+    if(series_values == NULL || sim_time < series_time) return 0;
+    if(series_count < series_alloc) return 1;
+    while(series_time <= sim_time) {
+        ++series_dropped;
+        series_time += series_interval;
+    }
+    return 0;
+}
+
+
+void series_sample(double value, int column)
+{
+
+/* Set column "column" of the sample that is due to value. */
+
+    if(column < 1 || column > series_columns || series_count >= series_alloc) {
+        printf("\n%d is an improper column of the time series at time %f\n",
+            column, sim_time);
+        exit(1);
+    }
+    series_values[column * series_alloc + series_count] = value;
+}
+
+
+void series_next(void)
+{
+
+/* End the sample that is due, stamping it with its time. */
+
+    series_values[series_count] = series_time;
+    ++series_count;
+    series_time += series_interval;
+}
+
+
+long out_series(FILE *unit, const char *names[])
+{
+
+/* Write the time series on file "unit" as CSV, with the column names
+   names[1] through names[columns] after Time, and return the number of
+   samples dropped because the series was full. */
+
+    long row;
+    int  column;
+
+    fprintf(unit, "Time");
+    for(column = 1; column <= series_columns; ++column)
+        fprintf(unit, ",%s", names[column]);
+    fprintf(unit, "\n");
+    for(row = 0; row < series_count; ++row) {
+        fprintf(unit, "%.2f", series_values[row]);
+        for(column = 1; column <= series_columns; ++column)
+            fprintf(unit, ",%.6g", series_values[column * series_alloc + row]);
+        fprintf(unit, "\n");
+    }
+    return series_dropped;
+}
+
+
+void series_stop(void)
+{
+
+/* Free the time series. */
+
+    memory_free(series_values, MEM_STAT);
+    series_values  = NULL;
+    series_alloc   = 0;
+    series_count   = 0;
+    series_dropped = 0;
+    series_columns = 0;
+}
+
+
+void out_sampst(FILE *unit, int lowvar, int highvar)
+{
+
+/* Write sampst statistics for variables lowvar through highvar on file
+   "unit".  Variables with a quantile sketch get a second line with their
+   50th, 90th and 99th percentiles. */
 
     int ivar, iatrr;
 
@@ -540,16 +1871,24 @@ void out_sampst(FILE *unit, int lowvar, int highvar)
     fprintf(unit, "\n sampst                         Number");
     fprintf(unit, "\nvariable                          of");
     fprintf(unit, "\n number       Average           values          Maximum");
-    fprintf(unit, "          Minimum");
+    fprintf(unit, "          Minimum        Std. dev.");
     fprintf(unit, "\n___________________________________");
-    fprintf(unit, "_____________________________________");
+    fprintf(unit, "______________________________________________________");
     for(ivar = lowvar; ivar <= highvar; ++ivar) {
         fprintf(unit, "\n\n%5d", ivar);
         sampst(0.00, -ivar);
         for(iatrr = 1; iatrr <= 4; ++iatrr) pprint_out(unit, iatrr);
+        fprintf(unit, " %#15.6G ", sqrt(sampst_variance(ivar)));
+        if(sampst_sketch[ivar] != NULL) {
+            fprintf(unit, "\n     ");
+            fprintf(unit, " %#15.6G ", sampst_quantile(ivar, 0.50));
+            fprintf(unit, " %#15.6G ", sampst_quantile(ivar, 0.90));
+            fprintf(unit, " %#15.6G ", sampst_quantile(ivar, 0.99));
+            fprintf(unit, "  (50%%, 90%%, 99%%)");
+        }
     }
     fprintf(unit, "\n___________________________________");
-    fprintf(unit, "_____________________________________\n\n\n");
+    fprintf(unit, "______________________________________________________\n\n\n");
 }
 
 
@@ -566,14 +1905,15 @@ void out_timest(FILE *unit, int lowvar, int highvar)
 
     fprintf(unit, "\n  timest");
     fprintf(unit, "\n variable       Time");
-    fprintf(unit, "\n  number       average          Maximum          Minimum");
-    fprintf(unit, "\n________________________________________________________");
+    fprintf(unit, "\n  number       average          Maximum          Minimum        Std. dev.");
+    fprintf(unit, "\n_________________________________________________________________________");
     for(ivar = lowvar; ivar <= highvar; ++ivar) {
         fprintf(unit, "\n\n%5d", ivar);
         timest(0.00, -ivar);
         for(iatrr = 1; iatrr <= 3; ++iatrr) pprint_out(unit, iatrr);
+        fprintf(unit, " %#15.6G ", sqrt(timest_variance(ivar)));
     }
-    fprintf(unit, "\n________________________________________________________");
+    fprintf(unit, "\n_________________________________________________________________________");
     fprintf(unit, "\n\n\n");
 }
 
@@ -589,18 +1929,303 @@ void out_filest(FILE *unit, int lowlist, int highlist)
     if(lowlist > highlist || lowlist > MAX_LIST || highlist > MAX_LIST) return;
 
     fprintf(unit, "\n  File         Time");
-    fprintf(unit, "\n number       average          Maximum          Minimum");
-    fprintf(unit, "\n_______________________________________________________");
+    fprintf(unit, "\n number       average          Maximum          Minimum        Std. dev.");
+    fprintf(unit, "\n________________________________________________________________________");
     for(list = lowlist; list <= highlist; ++list) {
         fprintf(unit, "\n\n%5d", list);
         filest(list);
         for(iatrr = 1; iatrr <= 3; ++iatrr) pprint_out(unit, iatrr);
+        fprintf(unit, " %#15.6G ", sqrt(timest_variance(TIM_VAR + list)));
+    }
+    fprintf(unit, "\n________________________________________________________________________");
+    fprintf(unit, "\n\n\n");
+
+    if(memory_in_filest) out_memory(unit);
+}
+
+
+void memory_get(struct memory_telemetry *telemetry)
+{
+
+/* Copy the memory telemetry since init_simlib into "telemetry". */
+
+    size_t heap_allocs = 0, heap_frees = 0, heap_growths = 0;
+    int    subsystem, list;
+
+    for(subsystem = 1; subsystem <= MAX_MEM; ++subsystem) {
+        telemetry->allocs[subsystem] = memory_allocs[subsystem];
+        telemetry->frees[subsystem]  = memory_frees[subsystem];
+    }
+    telemetry->event_bytes = 0;
+    telemetry->event_count = 0;
+    if(event_radix != NULL) {
+        radixheap_counts(event_radix, &heap_allocs, &heap_frees, &heap_growths);
+        telemetry->event_bytes = radixheap_bytes(event_radix);
+        telemetry->event_count = (long) radixheap_size(event_radix);
+    } else if(event_heap != NULL) {
+        minheap_counts(event_heap, &heap_allocs, &heap_frees, &heap_growths);
+        telemetry->event_bytes = minheap_bytes(event_heap);
+        telemetry->event_count = (long) minheap_size(event_heap);
+    }
+    telemetry->allocs[MEM_EVENT] = memory_heap_allocs + (long) heap_allocs;
+    telemetry->frees[MEM_EVENT]  = memory_heap_frees + (long) heap_frees;
+    telemetry->event_growths     = memory_heap_growths + (long) heap_growths;
+    telemetry->event_peak        = event_list_peak;
+
+    /* A list record is its struct master and its attribute array. */
+
+    for(list = 0; list <= MAX_LIST; ++list) {
+        telemetry->list_bytes[list] = 0;
+        telemetry->list_peak[list]  = 0;
+        if(list < 1 || list > maxlist || list_size == NULL) continue;
+        telemetry->list_bytes[list] = list_size[list] *
+            (sizeof(struct master) + (maxatr + 1) * sizeof(double));
+        telemetry->list_peak[list]  = list_peak[list];
+    }
+}
+
+
+void memory_report(int on)
+{
+
+/* Choose whether out_filest also writes the memory telemetry. */
+
+    memory_in_filest = on;
+}
+
+
+void out_memory(FILE *unit)
+{
+
+/* Write the memory telemetry since init_simlib on file "unit". */
+
+    static const char *subsystem_name[] =
+        { "", "core", "lists", "event heap", "statistics", "checkpoint" };
+    struct memory_telemetry telemetry;
+    int    subsystem, list;
+
+    memory_get(&telemetry);
+    fprintf(unit, "\n Subsystem         Allocations           Frees     Blocks held");
+    fprintf(unit, "\n________________________________________________________________________");
+    for(subsystem = 1; subsystem <= MAX_MEM; ++subsystem)
+        fprintf(unit, "\n%-15s %13ld %15ld %15ld", subsystem_name[subsystem],
+                telemetry.allocs[subsystem], telemetry.frees[subsystem],
+                telemetry.allocs[subsystem] - telemetry.frees[subsystem]);
+    fprintf(unit, "\n________________________________________________________________________");
+    fprintf(unit, "\n\n Event heap: %lu bytes, %ld events (peak %ld), %ld growths",
+            (unsigned long) telemetry.event_bytes, telemetry.event_count,
+            telemetry.event_peak, telemetry.event_growths);
+    fprintf(unit, "\n\n  List         Bytes held     Peak length");
+    fprintf(unit, "\n________________________________________________________________________");
+    for(list = 1; list <= maxlist; ++list) {
+        if(telemetry.list_peak[list] == 0) continue;
+        fprintf(unit, "\n%6d %18lu %15ld", list,
+                (unsigned long) telemetry.list_bytes[list], telemetry.list_peak[list]);
     }
-    fprintf(unit, "\n_______________________________________________________");
+    fprintf(unit, "\n________________________________________________________________________");
     fprintf(unit, "\n\n\n");
 }
 
 
+void out_profile(FILE *unit)
+{
+
+/* Write the SIMLIB_PROFILE counters since init_simlib on file "unit": the
+   events of each type with their sampled handler time and its estimated
+   total, the sampled cost of the event list operations, and the calls and
+   high-water mark of each list. */
+
+#ifdef SIMLIB_PROFILE
+    int    type, list;
+    double mean;
+
+    fprintf(unit, "\nsimlib profile at time %.6G: %ld events, times sampled on 1 call in %d",
+            sim_time, events_processed, PROFILE_SAMPLE);
+    fprintf(unit, "\n          Event         Count    Share   ns/handler    Est. seconds");
+    fprintf(unit, "\n________________________________________________________________________");
+    for(type = 0; type <= MAX_EVENT_TYPE; ++type) {
+        if(profile_events[type] == 0) continue;
+        mean = (profile_handler_samples[type] > 0)
+               ? profile_handler_time[type] / profile_handler_samples[type] : 0.0;
+        fprintf(unit, "\n%15d %13ld %7.2f%% %12.1f %15.4f", type,
+                profile_events[type],
+                100.0 * profile_events[type] / events_processed,
+                1.E9 * mean, mean * profile_events[type]);
+    }
+    mean = (profile_timing_samples > 0)
+           ? profile_timing_time / profile_timing_samples : 0.0;
+    fprintf(unit, "\n%15s %13ld %8s %12.1f %15.4f", "timing", events_processed,
+            "", 1.E9 * mean, mean * events_processed);
+    mean = (profile_schedule_samples > 0)
+           ? profile_schedule_time / profile_schedule_samples : 0.0;
+    fprintf(unit, "\n%15s %13ld %8s %12.1f %15.4f", "event_schedule",
+            profile_schedules, "", 1.E9 * mean, mean * profile_schedules);
+    fprintf(unit, "\n________________________________________________________________________");
+    fprintf(unit, "\nEvent list peak %ld", event_list_peak);
+    fprintf(unit, "\n\n           List     list_file   list_remove   Peak length");
+    fprintf(unit, "\n________________________________________________________________________");
+    for(list = 1; list <= maxlist; ++list) {
+        if(profile_files[list] == 0 && profile_removes[list] == 0) continue;
+        fprintf(unit, "\n%15d %13ld %13ld %13ld", list, profile_files[list],
+                profile_removes[list], list_peak[list]);
+    }
+    fprintf(unit, "\n\n");
+#else
+    fprintf(unit, "\nsimlib was compiled without SIMLIB_PROFILE\n");
+#endif
+}
+
+
+static void trace_spill(void)
+{
+    if(trace_count > 0 &&
+       fwrite(trace_buffer, sizeof(struct trace_record), trace_count,
+              trace_unit) != (size_t) trace_count) {
+        printf("Error writing the event trace at time %f\n", sim_time);
+        exit(1);
+    }
+    trace_count = 0;
+}
+
+
+static void trace_event(void)
+{
+
+/* Record the event just removed by timing, or check it against the trace. */
+
+    struct trace_record record, *expected;
+    int    i;
+
+    memset(&record, 0, sizeof(record));
+    record.index = events_processed;
+    record.type  = next_event_type;
+    record.time  = sim_time;
+    for(i = 0; i < TRACE_ATTR && 3 + i <= maxatr; ++i)
+        record.attribute[i] = transfer[3 + i];
+    for(i = 0; i < TRACE_STREAMS; ++i)
+        record.stream[i] = lcgrandgt(i + 1);
+
+    if(trace_mode == TRACE_RECORD) {
+        trace_buffer[trace_count++] = record;
+        if(trace_count == TRACE_BUFFER) trace_spill();
+        return;
+    }
+
+    if(record.index >= trace_print_from) {
+        printf("Event %ld at time %.6f: type %ld, attributes", record.index,
+               record.time, record.type);
+        for(i = 0; i < TRACE_ATTR; ++i) printf(" %g", record.attribute[i]);
+        printf(", streams");
+        for(i = 0; i < TRACE_STREAMS; ++i) printf(" %ld", record.stream[i]);
+        printf("\n");
+    }
+    if(trace_diverged) return;
+    if(trace_next == trace_count) {
+        trace_count = (int) fread(trace_buffer, sizeof(struct trace_record),
+                                  TRACE_BUFFER, trace_unit);
+        trace_next  = 0;
+        if(trace_count == 0) {
+            printf("Replay goes past the end of the trace at event %ld\n",
+                   record.index);
+            trace_diverged = 1;
+            return;
+        }
+    }
+    expected = &trace_buffer[trace_next++];
+    if(memcmp(expected, &record, sizeof(record)) != 0) {
+        printf("Replay differs from the trace at event %ld: type %ld at time %.6f in the trace, type %ld at time %.6f now\n",
+               record.index, expected->type, expected->time, record.type,
+               record.time);
+        trace_diverged = 1;
+    }
+}
+
+
+void trace_start(const char *filename, int mode, long print_from)
+{
+
+/* Start tracing the events removed by timing, from the next one on.  With
+   mode TRACE_RECORD they are written to file "filename".  With TRACE_REPLAY
+   that file is read from the record of the next event on (so a run restored
+   from a checkpoint jumps there), every event is checked against it and the
+   first difference is reported, and the events from number print_from on are
+   written to standard output. */
+
+    struct trace_header header;
+    long   first;
+
+    if(trace_mode != 0) trace_stop();
+
+    if(mode == TRACE_RECORD) {
+        trace_unit = fopen(filename, "wb");
+        if(trace_unit == NULL) {
+            printf("Could not open trace file %s\n", filename);
+            exit(1);
+        }
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "SIMTRACE", 8);
+        header.version     = 1;
+        header.record_size = sizeof(struct trace_record);
+        header.attributes  = TRACE_ATTR;
+        header.streams     = TRACE_STREAMS;
+        if(fwrite(&header, sizeof(header), 1, trace_unit) != 1) {
+            printf("Error writing trace file %s\n", filename);
+            exit(1);
+        }
+    }
+    else if(mode == TRACE_REPLAY) {
+        trace_unit = fopen(filename, "rb");
+        if(trace_unit == NULL) {
+            printf("Could not open trace file %s\n", filename);
+            exit(1);
+        }
+        if(fread(&header, sizeof(header), 1, trace_unit) != 1 ||
+           memcmp(header.magic, "SIMTRACE", 8) != 0 ||
+           header.record_size != (long) sizeof(struct trace_record)) {
+            printf("%s is not a trace file of this simlib\n", filename);
+            exit(1);
+        }
+        first = events_processed + 1;
+        if(fread(&trace_buffer[0], sizeof(struct trace_record), 1,
+                 trace_unit) == 1) {
+            first = trace_buffer[0].index;
+        }
+        if(events_processed + 1 < first) {
+            printf("Trace file %s starts at event %ld, after event %ld\n",
+                   filename, first, events_processed + 1);
+            exit(1);
+        }
+        fseek(trace_unit, (long) sizeof(header) + (events_processed + 1 - first) *
+              (long) sizeof(struct trace_record), SEEK_SET);
+    }
+    else {
+        printf("%d is an invalid trace mode\n", mode);
+        exit(1);
+    }
+    trace_mode       = mode;
+    trace_count      = 0;
+    trace_next       = 0;
+    trace_print_from = print_from;
+    trace_first      = events_processed + 1;
+    trace_diverged   = 0;
+}
+
+
+void trace_stop(void)
+{
+
+/* Stop tracing, writing out the buffered events. */
+
+    if(trace_mode == TRACE_RECORD) trace_spill();
+    if(trace_mode == TRACE_REPLAY && !trace_diverged &&
+       events_processed >= trace_first)
+        printf("Replay matches the trace from event %ld to event %ld\n",
+               trace_first, events_processed);
+    if(trace_mode != 0) fclose(trace_unit);
+    trace_mode = 0;
+}
+
+
 void pprint_out(FILE *unit, int i) /* Write ith entry in transfer to file
                                       "unit". */
 {
@@ -611,6 +2236,343 @@ void pprint_out(FILE *unit, int i) /* Write ith entry in transfer to file
 }
 
 
+/* Checkpoints.  checkpoint_save writes the complete simlib state (sim_time,
+   transfer, all lists, the event heap, the sampst, timest, batchst and cvst
+   accumulators, quantile sketches, the MSER-5 detector and all lcgrand
+   streams) to a binary file, followed by the memory regions the model
+   registered with checkpoint_region.  checkpoint_restore maps such a file
+   with mmap and puts everything back, so the run continues exactly as the
+   saved one would have.  The header carries the key the model set with
+   checkpoint_key, and a file saved under another key is refused.  The file
+   is in native byte order; it can only be restored by the same build on the
+   same kind of machine. */
+
+struct checkpoint_header {
+    char    magic[8];
+    long    version;
+    long    maxatr;
+    long    maxlist;
+    long    events;         /* Records in the event heap. */
+    long    regions;        /* Model regions that follow the simlib state. */
+    long    next_event_type;
+    long    events_processed;
+    double  sim_time;
+    char    key[CHECKPOINT_KEY]; /* checkpoint_key of the saved run. */
+};
+
+static FILE          *checkpoint_unit;
+static const char    *checkpoint_cursor, *checkpoint_end;
+
+
+static void checkpoint_write(const void *data, size_t size)
+{
+    if(size > 0 && fwrite(data, size, 1, checkpoint_unit) != 1) {
+        printf("Error writing checkpoint at time %f\n", sim_time);
+        exit(1);
+    }
+}
+
+
+static void checkpoint_read(void *data, size_t size)
+{
+    if((size_t)(checkpoint_end - checkpoint_cursor) < size) {
+        printf("Checkpoint file is truncated\n");
+        exit(1);
+    }
+    memcpy(data, checkpoint_cursor, size);
+    checkpoint_cursor += size;
+}
+
+
+void checkpoint_region(void *address, size_t size)
+{
+
+/* Add a region of model memory (a global variable or array) to the state
+   saved and restored by checkpoints.  The regions are forgotten by
+   init_simlib, so they are registered again for every run, in the same
+   order. */
+
+    if(checkpoint_regions == MAX_REGION) {
+        printf("Too many checkpoint regions (at most %d)\n", MAX_REGION);
+        exit(1);
+    }
+    region_address[checkpoint_regions] = address;
+    region_size[checkpoint_regions]    = size;
+    ++checkpoint_regions;
+}
+
+
+void checkpoint_key(const char *key)
+{
+
+/* Set the key that checkpoint_save stores with the state and that
+   checkpoint_restore requires, such as the parameters, seeds and run that
+   shaped the state.  Like the regions, the key is forgotten by
+   init_simlib. */
+
+    if(strlen(key) >= CHECKPOINT_KEY) {
+        printf("Checkpoint key is too long (at most %d characters)\n",
+               CHECKPOINT_KEY - 1);
+        exit(1);
+    }
+    strcpy(checkpoint_key_text, key);
+}
+
+
+void checkpoint_save(const char *filename)
+{
+
+/* Save the simulation state to file "filename".  Call it between events
+   (not from inside an event routine), since the rest of the routine would
+   not be part of the saved state. */
+
+    struct checkpoint_header header;
+    struct master *row;
+    int    list, ivar, has_sketch;
+    long   stream, zrng_value, region_bytes;
+    size_t ievent, count;
+
+    checkpoint_unit = fopen(filename, "wb");
+    if(checkpoint_unit == NULL) {
+        printf("Could not open checkpoint file %s\n", filename);
+        exit(1);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SIMLIBCK", 8);
+    header.version         = 3;
+    header.maxatr          = maxatr;
+    header.maxlist         = maxlist;
+    header.events          = (long) event_count();
+    header.regions         = checkpoint_regions;
+    header.next_event_type = next_event_type;
+    header.events_processed = events_processed;
+    header.sim_time        = sim_time;
+    strcpy(header.key, checkpoint_key_text);
+    checkpoint_write(&header, sizeof(header));
+
+    /* Lists, from head to tail. */
+
+    checkpoint_write(transfer, (maxatr + 1) * sizeof(double));
+    checkpoint_write(list_rank, (maxlist + 1) * sizeof(int));
+    checkpoint_write(list_size, (maxlist + 1) * sizeof(int));
+    for(list = 1; list <= maxlist; ++list)
+        for(row = head[list]; row != NULL; row = row->sr)
+            checkpoint_write(row->value, (maxatr + 1) * sizeof(double));
+
+    /* The event list, in array (or bucket) order. */
+
+    count = event_count();
+    for(ievent = 0; ievent < count; ++ievent)
+        checkpoint_write(event_element(ievent), event_alloc_size);
+
+    /* Statistical routines. */
+
+    checkpoint_write(sampst_acc, sizeof(sampst_acc));
+    checkpoint_write(timest_acc, sizeof(timest_acc));
+    for(ivar = 1; ivar <= MAX_SVAR; ++ivar) {
+        has_sketch = (sampst_sketch[ivar] != NULL);
+        checkpoint_write(&has_sketch, sizeof(int));
+        if(has_sketch)
+            checkpoint_write(sampst_sketch[ivar], sizeof(struct quantile_sketch));
+    }
+    checkpoint_write(batch_mean, sizeof(batch_mean));
+    checkpoint_write(batch_sum, sizeof(batch_sum));
+    checkpoint_write(batch_size, sizeof(batch_size));
+    checkpoint_write(batch_fill, sizeof(batch_fill));
+    checkpoint_write(batch_count, sizeof(batch_count));
+    checkpoint_write(cv_shift_y, sizeof(cv_shift_y));
+    checkpoint_write(cv_shift_c, sizeof(cv_shift_c));
+    checkpoint_write(cv_sum_y, sizeof(cv_sum_y));
+    checkpoint_write(cv_sum_yy, sizeof(cv_sum_yy));
+    checkpoint_write(cv_sum_c, sizeof(cv_sum_c));
+    checkpoint_write(cv_sum_yc, sizeof(cv_sum_yc));
+    checkpoint_write(cv_sum_cc, sizeof(cv_sum_cc));
+    checkpoint_write(cv_count, sizeof(cv_count));
+    checkpoint_write(&mser_count, sizeof(long));
+    checkpoint_write(&mser_point, sizeof(long));
+    checkpoint_write(&mser_in_batch, sizeof(int));
+    checkpoint_write(&mser_batch_sum, sizeof(double));
+    checkpoint_write(mser_means, mser_count * sizeof(double));
+
+    /* Random-number streams. */
+
+    for(stream = 1; stream <= MAX_STREAM; ++stream) {
+        zrng_value = lcgrandgt((int) stream);
+        checkpoint_write(&zrng_value, sizeof(long));
+    }
+    checkpoint_write(lcgrand_flip, sizeof(lcgrand_flip));
+
+    /* Model regions, each preceded by its size. */
+
+    for(ivar = 0; ivar < checkpoint_regions; ++ivar) {
+        region_bytes = (long) region_size[ivar];
+        checkpoint_write(&region_bytes, sizeof(long));
+        checkpoint_write(region_address[ivar], region_size[ivar]);
+    }
+
+    if(fclose(checkpoint_unit) != 0) {
+        printf("Error writing checkpoint file %s\n", filename);
+        exit(1);
+    }
+    checkpoint_unit = NULL;
+}
+
+
+int checkpoint_restore(const char *filename)
+{
+
+/* Restore the simulation state saved by checkpoint_save in file "filename".
+   init_simlib must have been called, with the same maxatr and maxlist, and
+   the model must have registered the same regions and set the same key.  Returns 0, changing
+   nothing, if the file cannot be opened, and 1 once the state is restored. */
+
+    struct checkpoint_header header;
+    struct stat info;
+    void   *map;
+    double *record, tick;
+    size_t heap_allocs, heap_frees, heap_growths;
+    int    fd, list, ivar, has_sketch;
+    long   stream, zrng_value, region_bytes, ievent;
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0) return 0;
+    if(fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(header)) {
+        printf("Checkpoint file %s is truncated\n", filename);
+        exit(1);
+    }
+    map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        printf("Could not map checkpoint file %s\n", filename);
+        exit(1);
+    }
+    checkpoint_cursor = (const char *) map;
+    checkpoint_end    = checkpoint_cursor + info.st_size;
+
+    checkpoint_read(&header, sizeof(header));
+    if(memcmp(header.magic, "SIMLIBCK", 8) != 0 || header.version != 3) {
+        printf("%s is not a checkpoint file\n", filename);
+        exit(1);
+    }
+    if(header.maxatr != maxatr || header.maxlist != maxlist ||
+       header.regions != checkpoint_regions) {
+        printf("Checkpoint file %s does not match this model\n", filename);
+        exit(1);
+    }
+    header.key[CHECKPOINT_KEY - 1] = '\0';
+    if(strcmp(header.key, checkpoint_key_text) != 0) {
+        printf("Checkpoint file %s was saved by another run:\n  saved: %s\n  this:  %s\n",
+               filename, header.key, checkpoint_key_text);
+        exit(1);
+    }
+
+    /* Empty the lists and the event heap, then refill them.  Filing the
+       records at the end of each list updates the list statistics, which
+       are overwritten with the saved ones below. */
+
+    for(list = 1; list <= maxlist; ++list)
+        while(head[list] != NULL) list_remove(FIRST, list);
+    minheap_counts(event_heap, &heap_allocs, &heap_frees, &heap_growths);
+    memory_heap_allocs  += heap_allocs;
+    memory_heap_frees   += heap_frees;
+    memory_heap_growths += heap_growths;
+    minheap_destroy(event_heap);
+    event_heap = minheap_construct(event_alloc_size, event_later);
+    if(event_heap == NULL) {
+        printf("out of memory");
+        exit(1);
+    }
+    if(event_radix != NULL) {
+        tick = event_tick;
+        event_radix_destroy();
+        event_tick = 0.0;
+        event_ticks(tick);
+    }
+
+    checkpoint_read(transfer, (maxatr + 1) * sizeof(double));
+    record = (double *) memory_alloc(event_alloc_size, MEM_CHECKPOINT);
+    memcpy(record, transfer, event_alloc_size);
+    checkpoint_read(list_rank, (maxlist + 1) * sizeof(int));
+    checkpoint_read(list_size, (maxlist + 1) * sizeof(int));
+    for(list = 1; list <= maxlist; ++list) {
+        ievent = list_size[list];
+        list_size[list] = 0;
+        for(; ievent > 0; --ievent) {
+            checkpoint_read(transfer, (maxatr + 1) * sizeof(double));
+            list_file(LAST, list);
+        }
+    }
+    memcpy(transfer, record, event_alloc_size);
+
+    for(ievent = 0; ievent < header.events; ++ievent) {
+        checkpoint_read(record, event_alloc_size);
+        event_insert(record);
+    }
+    memory_free(record, MEM_CHECKPOINT);
+    event_list_peak = (long) header.events;
+    events_processed = header.events_processed;
+
+    checkpoint_read(sampst_acc, sizeof(sampst_acc));
+    checkpoint_read(timest_acc, sizeof(timest_acc));
+    for(ivar = 1; ivar <= MAX_SVAR; ++ivar) {
+        checkpoint_read(&has_sketch, sizeof(int));
+        if(has_sketch) {
+            sampst_quantiles(ivar);
+            checkpoint_read(sampst_sketch[ivar], sizeof(struct quantile_sketch));
+        }
+        else {
+            memory_free(sampst_sketch[ivar], MEM_STAT);
+            sampst_sketch[ivar] = NULL;
+        }
+    }
+    checkpoint_read(batch_mean, sizeof(batch_mean));
+    checkpoint_read(batch_sum, sizeof(batch_sum));
+    checkpoint_read(batch_size, sizeof(batch_size));
+    checkpoint_read(batch_fill, sizeof(batch_fill));
+    checkpoint_read(batch_count, sizeof(batch_count));
+    checkpoint_read(cv_shift_y, sizeof(cv_shift_y));
+    checkpoint_read(cv_shift_c, sizeof(cv_shift_c));
+    checkpoint_read(cv_sum_y, sizeof(cv_sum_y));
+    checkpoint_read(cv_sum_yy, sizeof(cv_sum_yy));
+    checkpoint_read(cv_sum_c, sizeof(cv_sum_c));
+    checkpoint_read(cv_sum_yc, sizeof(cv_sum_yc));
+    checkpoint_read(cv_sum_cc, sizeof(cv_sum_cc));
+    checkpoint_read(cv_count, sizeof(cv_count));
+    mser_init();
+    checkpoint_read(&mser_count, sizeof(long));
+    checkpoint_read(&mser_point, sizeof(long));
+    checkpoint_read(&mser_in_batch, sizeof(int));
+    checkpoint_read(&mser_batch_sum, sizeof(double));
+    if(mser_count > 0) {
+        mser_alloc = mser_count;
+        mser_means = (double *) memory_alloc(mser_alloc * sizeof(double), MEM_STAT);
+        checkpoint_read(mser_means, mser_count * sizeof(double));
+    }
+
+    for(stream = 1; stream <= MAX_STREAM; ++stream) {
+        checkpoint_read(&zrng_value, sizeof(long));
+        lcgrandst(zrng_value, (int) stream);
+    }
+    checkpoint_read(lcgrand_flip, sizeof(lcgrand_flip));
+
+    for(ivar = 0; ivar < checkpoint_regions; ++ivar) {
+        checkpoint_read(&region_bytes, sizeof(long));
+        if(region_bytes != (long) region_size[ivar]) {
+            printf("Checkpoint file %s does not match this model\n", filename);
+            exit(1);
+        }
+        checkpoint_read(region_address[ivar], region_size[ivar]);
+    }
+
+    sim_time        = header.sim_time;
+    next_event_type = (int) header.next_event_type;
+
+    munmap(map, (size_t) info.st_size);
+    return 1;
+}
+
+
 double expon(double mean, int stream) /* Exponential variate generation
                                        function. */
 {
@@ -731,6 +2693,7 @@ double lcgrand(int stream)
              ((hi31 & 32767) << 16) + (hi31 >> 15);
     if (zi < 0) zi += MODLUS;
     zrng[stream] = zi;
+    if (lcgrand_flip[stream]) return 1.0 - (zi >> 7 | 1) / 16777216.0;
     return (zi >> 7 | 1) / 16777216.0;
 }
 
@@ -746,3 +2709,60 @@ long lcgrandgt (int stream) /* Return the current zrng for stream "stream". */
 {
     return zrng[stream];
 }
+
+
+void lcgrand_antithetic(int stream, int on) /* Make stream "stream" return
+                                               antithetic numbers. */
+{
+
+/* With on = 1, lcgrand returns 1 - u in place of each u it would return for
+   stream "stream" (both lie strictly between 0 and 1), and so does every
+   variate generated from it.  A run repeated from the same seeds with its
+   streams antithetic is the antithetic partner of the first run; see
+   pairst.  on = 0 switches back. */
+
+    lcgrand_flip[stream] = on;
+}
+
+
+static long lcgrand_multiply(long a, long z) /* Return a * z mod MODLUS for
+                                                 0 <= a, z < MODLUS. */
+{
+    double hi;
+
+    /* Split a into 15- and 16-bit halves, so that every product and sum
+       stays below 2^53 and is exact in double precision. */
+
+    hi = fmod((double)(a >> 16) * (double) z, (double) MODLUS);
+    return (long) fmod(hi * 65536.0 + (double)(a & 65535) * (double) z,
+                       (double) MODLUS);
+}
+
+
+long lcgrand_skip(long zset, long draws) /* Return the zrng that a stream
+                                            set to zset has after "draws"
+                                            further draws. */
+{
+
+/* One draw multiplies zrng by MULT1 * MULT2 mod MODLUS, so skipping "draws"
+   draws multiplies it by the draws-th power, found by repeated squaring.
+   The power for the last distance is kept, so skipping repeatedly by the
+   same distance (e.g. to set up equally spaced substreams) costs a single
+   multiplication.  Substreams of one seed are disjoint as long as they fit
+   into the period MODLUS - 1 of the generator. */
+
+    static long last_draws = 0, last_power = 1;
+    long   power, square, n;
+
+    if(draws != last_draws) {
+        power  = 1;
+        square = lcgrand_multiply(MULT1, MULT2);
+        for(n = draws; n > 0; n >>= 1) {
+            if(n & 1) power = lcgrand_multiply(power, square);
+            square = lcgrand_multiply(square, square);
+        }
+        last_draws = draws;
+        last_power = power;
+    }
+    return lcgrand_multiply(last_power, zset);
+}
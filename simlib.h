@@ -11,6 +11,7 @@
 
 extern int    *list_rank, *list_size, next_event_type, maxatr, maxlist;
 extern double  *transfer, sim_time, prob_distrib[26];
+extern long    events_processed, event_list_peak;
 
 struct master {
     double  *value;
@@ -20,20 +21,133 @@ struct master {
 
 extern struct master **head, **tail;
 
+/* Accumulators of one sampst variable.  They can be copied out with
+   sampst_get (e.g. to write them to a file or pipe), restored with sampst_set
+   and pooled across replications or workers with sampst_merge. */
+
+struct sampst_accumulator {
+    long    num_observations;
+    double  sum;
+    double  max;
+    double  min;
+    double  mean;   /* Running mean (Welford). */
+    double  m2;     /* Running sum of squared deviations from the mean. */
+};
+
+/* Fixed-size quantile sketch of one sampst variable (logarithmic bins with
+   relative accuracy SKETCH_ALPHA, as in DDSketch).  Sketches add bin by bin,
+   so they merge exactly. */
+
+struct quantile_sketch {
+    long    count;
+    long    zero_count;             /* Magnitude below SKETCH_MIN. */
+    long    positive[SKETCH_BINS];
+    long    negative[SKETCH_BINS];
+};
+
+/* Accumulators of one timest variable; see struct sampst_accumulator. */
+
+struct timest_accumulator {
+    double  area;
+    double  max;
+    double  min;
+    double  preval;     /* Current level of the variable. */
+    double  tlvc;       /* Time of last value change. */
+    double  duration;   /* Time over which area has been accumulated. */
+    double  mean;       /* Running time-weighted mean. */
+    double  m2;         /* Running time-weighted sum of squared deviations. */
+};
+
+/* Memory telemetry since init_simlib, by subsystem (MEM_CORE through
+   MAX_MEM), from memory_get.  Blocks held are allocs - frees. */
+
+struct memory_telemetry {
+    long    allocs[MEM_SIZE];   /* malloc, calloc and realloc calls. */
+    long    frees[MEM_SIZE];    /* free calls. */
+    size_t  event_bytes;        /* Bytes held by the event heap. */
+    long    event_count;        /* Events in the event list. */
+    long    event_peak;         /* Largest number of events. */
+    long    event_growths;      /* Times the event heap grew. */
+    size_t  list_bytes[LIST_SIZE];  /* Bytes held by the records of each list. */
+    long    list_peak[LIST_SIZE];   /* Longest length of each list. */
+};
+
+/* Event traces (trace_start).  A trace file is a struct trace_header followed
+   by one struct trace_record per event removed by timing, in order, so record
+   i of a trace starting at event "first" is at sizeof(struct trace_header) +
+   (i - first) * sizeof(struct trace_record). */
+
+struct trace_header {
+    char    magic[8];           /* "SIMTRACE". */
+    long    version;
+    long    record_size;        /* sizeof(struct trace_record). */
+    long    attributes;         /* TRACE_ATTR. */
+    long    streams;            /* TRACE_STREAMS. */
+};
+
+struct trace_record {
+    long    index;              /* events_processed, counting this event. */
+    long    type;
+    double  time;
+    double  attribute[TRACE_ATTR];  /* transfer[3] onward (0 past maxatr). */
+    long    stream[TRACE_STREAMS];  /* lcgrandgt of streams 1 onward, before
+                                       the event is handled. */
+};
+
 /* Declare simlib functions. */
 
 void  init_simlib(void);
 void  cleanup_simlib(void);
 void  list_file(int option, int list);
 void  list_remove(int option, int list);
+int   list_remove_match(int list, int attribute, double value);
 void  timing(void);
+int   timing_batch(double *events, int max_events);
+void  event_ticks(double tick);
 void  event_schedule(double time_of_event, int type_of_event);
 double sampst(double value, int varibl);
+double sampst_variance(int variable);
+void  sampst_get(int variable, struct sampst_accumulator *acc);
+void  sampst_set(int variable, const struct sampst_accumulator *acc);
+void  sampst_merge(int variable, const struct sampst_accumulator *acc);
+void  sampst_quantiles(int variable);
+double sampst_quantile(int variable, double q);
+void  sampst_sketch_get(int variable, struct quantile_sketch *sketch);
+void  sampst_sketch_merge(int variable, const struct quantile_sketch *sketch);
 double timest(double value, int varibl);
+double timest_variance(int variable);
+void  timest_get(int variable, struct timest_accumulator *acc);
+void  timest_set(int variable, const struct timest_accumulator *acc);
+void  timest_merge(int variable, const struct timest_accumulator *acc);
+void  timest_restart(void);
+double batchst(double value, int variable);
+double t_quantile(int dof);
+double pairst(double value, int variable);
+double cvst(double value, const double *controls, int variable);
 double filest(int list);
+void  mser_init(void);
+int   mser_observe(double value);
+long  mser_truncation(void);
+double timest_level(int variable);
+void  series_start(double interval, int columns, long rows);
+int   series_due(void);
+void  series_sample(double value, int column);
+void  series_next(void);
+long  out_series(FILE *unit, const char *names[]);
+void  series_stop(void);
+void  checkpoint_region(void *address, size_t size);
+void  checkpoint_key(const char *key);
+void  checkpoint_save(const char *filename);
+int   checkpoint_restore(const char *filename);
 void  out_sampst(FILE *unit, int lowvar, int highvar);
 void  out_timest(FILE *unit, int lowvar, int highvar);
 void  out_filest(FILE *unit, int lowlist, int highlist);
+void  out_profile(FILE *unit);
+void  memory_get(struct memory_telemetry *telemetry);
+void  memory_report(int on);
+void  out_memory(FILE *unit);
+void  trace_start(const char *filename, int mode, long print_from);
+void  trace_stop(void);
 double expon(double mean, int stream);
 int   random_integer(double prob_distrib[], int stream);
 double uniform(double a, double b, int stream);
@@ -41,6 +155,8 @@ double erlang(int m, double mean, int stream);
 double lcgrand(int stream);
 void  lcgrandst(long zset, int stream);
 long  lcgrandgt(int stream);
+long  lcgrand_skip(long zset, long draws);
+void  lcgrand_antithetic(int stream, int on);
 
 #endif
 
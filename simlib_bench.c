@@ -0,0 +1,401 @@
+/* This is simlib_bench.c, microbenchmarks of the simlib primitives.
+
+   Every benchmark runs a fixed number of operations from fixed seeds, so
+   runs are reproducible, and is repeated BENCH_REPEAT times.  The fastest
+   repetition is reported, one CSV line per benchmark on standard output:
+
+       benchmark,size,ops,ns_per_op,allocs_per_op
+
+   where size is the number of records in the heap or list (0 if none) and
+   allocs_per_op counts the calls to malloc, calloc and realloc made by
+   simlib, minheap and the model code.  The program has to be linked with
+   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc for the counts (see the
+   bench target of the Makefile). */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "simlib.h"
+#include "minheap.h"
+#include <time.h>
+
+#define BENCH_REPEAT   3        /* Repetitions of each benchmark. */
+#define BENCH_SEED     1973272912L /* Seed of the stream the keys come from. */
+#define BENCH_STREAM   1        /* lcgrand stream of the keys. */
+#define BENCH_BATCH    256      /* Events per timing_batch call. */
+
+/* Allocation counting through the linker's --wrap. */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+static long bench_allocs;
+
+void *__wrap_malloc(size_t size)
+{
+    ++bench_allocs;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    ++bench_allocs;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    ++bench_allocs;
+    return __real_realloc(pointer, size);
+}
+
+/* The model's empirical cdf lookup (simulation_code.c, linked with its main
+   renamed). */
+
+extern int   cdf_size[1 + 1];
+extern float cdf[1 + 1][1 + max_cdf_size];
+int empric_cdf(float cdf_value, int arr_serv_no);
+
+/* Timing of one repetition. */
+
+static double bench_start_time, bench_best_time;
+static long   bench_start_allocs, bench_rep_allocs;
+
+static double bench_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1.E-9 * now.tv_nsec;
+}
+
+static void bench_begin(void)
+{
+    bench_start_allocs = bench_allocs;
+    bench_start_time   = bench_clock();
+}
+
+static void bench_end(void)
+{
+    double elapsed;
+
+    elapsed = bench_clock() - bench_start_time;
+    bench_rep_allocs = bench_allocs - bench_start_allocs;
+    if(bench_best_time < 0.0 || elapsed < bench_best_time)
+        bench_best_time = elapsed;
+}
+
+static void bench_report(const char *name, long size, long ops)
+{
+    printf("%s,%ld,%ld,%.2f,%.4f\n", name, size, ops,
+           1.E9 * bench_best_time / ops, (double) bench_rep_allocs / ops);
+    fflush(stdout);
+    bench_best_time = -1.0;
+}
+
+/* simlib state for the benchmarks that use it. */
+
+static void bench_init(void)
+{
+    maxatr  = MAX_ATTR;
+    maxlist = MAX_LIST;
+    init_simlib();
+    lcgrandst(BENCH_SEED, BENCH_STREAM);
+}
+
+/* Raw minheap of event times. */
+
+static bool bench_later(void *left, void *right)
+{
+    return *(double *) left > *(double *) right;
+}
+
+static void bench_minheap_fill(long size, long ops)
+{
+    struct MinHeapHandle *heap;
+    double key;
+    long   i, round;
+    int    rep;
+
+    /* Insert size random keys, then delete them all, in rounds on the same
+       heap until ops inserts and deletes are done. */
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        lcgrandst(BENCH_SEED, BENCH_STREAM);
+        heap = minheap_construct(sizeof(double), bench_later);
+        bench_begin();
+        for(round = 0; round < ops / (2 * size); ++round) {
+            for(i = 0; i < size; ++i) {
+                key = lcgrand(BENCH_STREAM);
+                minheap_insert(heap, &key);
+            }
+            while(!minheap_empty(heap))
+                minheap_delete_minimum(heap);
+        }
+        bench_end();
+        minheap_destroy(heap);
+    }
+    bench_report("minheap_insert_delete", size, ops / (2 * size) * 2 * size);
+}
+
+static void bench_minheap_hold(long size, long ops)
+{
+    struct MinHeapHandle *heap;
+    double key;
+    long   i;
+    int    rep;
+
+    /* The hold model: with size keys in the heap, each operation deletes
+       the minimum and inserts it again an exponential time later. */
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        lcgrandst(BENCH_SEED, BENCH_STREAM);
+        heap = minheap_construct(sizeof(double), bench_later);
+        for(i = 0; i < size; ++i) {
+            key = expon(1.0, BENCH_STREAM);
+            minheap_insert(heap, &key);
+        }
+        bench_begin();
+        for(i = 0; i < ops; ++i) {
+            key = *(double *) minheap_minimum(heap);
+            minheap_delete_minimum(heap);
+            key += expon(1.0, BENCH_STREAM);
+            minheap_insert(heap, &key);
+        }
+        bench_end();
+        minheap_destroy(heap);
+    }
+    bench_report("minheap_hold", size, ops);
+}
+
+static void bench_event_hold(long size, long ops, int ticks)
+{
+    static const char *name[] =
+        { "event_hold", "event_hold_whole", "event_hold_ticks",
+          "event_hold_batch" };
+    static double batch[BENCH_BATCH * (MAX_ATTR + 1)];
+    long i;
+    int  rep, count, ievent;
+
+    /* The hold model on the simlib event list, through event_schedule and
+       timing.  With ticks 1 the times are whole numbers, as in the model,
+       with ticks 2 they are also kept on ticks of 1 (event_ticks), and with
+       ticks 3 the events of each time are taken at once (timing_batch). */
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        bench_init();
+        if(ticks >= 2)
+            event_ticks(1.0);
+        for(i = 0; i < size; ++i)
+            event_schedule(ticks ? ceil(expon(10.0, BENCH_STREAM))
+                                 : expon(1.0, BENCH_STREAM), 1);
+        bench_begin();
+        for(i = 0; ticks == 3 && i < ops; i += count) {
+            count = timing_batch(batch, BENCH_BATCH);
+            for(ievent = 0; ievent < count; ++ievent)
+                event_schedule(sim_time + ceil(expon(10.0, BENCH_STREAM)), 1);
+        }
+        for(i = 0; ticks != 3 && i < ops; ++i) {
+            timing();
+            event_schedule(sim_time + (ticks ? ceil(expon(10.0, BENCH_STREAM))
+                                             : expon(1.0, BENCH_STREAM)), 1);
+        }
+        bench_end();
+        cleanup_simlib();
+    }
+    bench_report(name[ticks], size, ops);
+}
+
+/* Lists. */
+
+static void bench_list(int file_option, int remove_option, long size,
+                       long ops)
+{
+    static const char *option_name[] =
+        { "", "first", "last", "increasing", "decreasing" };
+    char name[64];
+    long i;
+    int  rep;
+
+    /* With size records in list 1, ranked on attribute 3, each operation
+       files a record with a random rank and removes one. */
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        bench_init();
+        list_rank[1] = 3;
+        for(i = 0; i < size; ++i) {
+            transfer[3] = lcgrand(BENCH_STREAM);
+            list_file(file_option, 1);
+        }
+        bench_begin();
+        for(i = 0; i < ops; ++i) {
+            transfer[3] = lcgrand(BENCH_STREAM);
+            list_file(file_option, 1);
+            list_remove(remove_option, 1);
+        }
+        bench_end();
+        cleanup_simlib();
+    }
+    sprintf(name, "list_file_%s_remove_%s", option_name[file_option],
+            option_name[remove_option]);
+    bench_report(name, size, ops);
+}
+
+/* Statistics. */
+
+static void bench_sampst(long ops)
+{
+    long i;
+    int  rep;
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        bench_init();
+        bench_begin();
+        for(i = 0; i < ops; ++i)
+            sampst(lcgrand(BENCH_STREAM), 1);
+        bench_end();
+        cleanup_simlib();
+    }
+    bench_report("sampst", 0, ops);
+}
+
+static void bench_timest(long ops)
+{
+    long i;
+    int  rep;
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        bench_init();
+        bench_begin();
+        for(i = 0; i < ops; ++i) {
+            sim_time += 1.0;
+            timest(lcgrand(BENCH_STREAM), 1);
+        }
+        bench_end();
+        cleanup_simlib();
+    }
+    bench_report("timest", 0, ops);
+}
+
+/* Random variates.  The sums keep the calls from being optimized away. */
+
+static volatile double bench_sink;
+
+static void bench_variate(const char *name, int kind, long ops)
+{
+    double sum;
+    long   i;
+    int    rep;
+
+    prob_distrib[1] = 0.25;
+    prob_distrib[2] = 0.5;
+    prob_distrib[3] = 0.75;
+    prob_distrib[4] = 1.0;
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        lcgrandst(BENCH_SEED, BENCH_STREAM);
+        sum = 0.0;
+        bench_begin();
+        switch(kind) {
+        case 1:
+            for(i = 0; i < ops; ++i)
+                sum += lcgrand(BENCH_STREAM);
+            break;
+        case 2:
+            for(i = 0; i < ops; ++i)
+                sum += expon(1.0, BENCH_STREAM);
+            break;
+        case 3:
+            for(i = 0; i < ops; ++i)
+                sum += erlang(3, 1.0, BENCH_STREAM);
+            break;
+        case 4:
+            for(i = 0; i < ops; ++i)
+                sum += random_integer(prob_distrib, BENCH_STREAM);
+            break;
+        case 5:
+            for(i = 0; i < ops; ++i)
+                sum += uniform(0.0, 1.0, BENCH_STREAM);
+            break;
+        }
+        bench_end();
+        bench_sink = sum;
+    }
+    bench_report(name, 0, ops);
+}
+
+static void bench_empric_cdf(long ops)
+{
+    FILE  *infile;
+    double sum;
+    float  extra;
+    long   i;
+    int    rep;
+
+    /* The service-time cdf of the model, as read by its main, with as many
+       entries as Inputs.in holds. */
+
+    infile = fopen("Inputs.in", "r");
+    if(infile == NULL) {
+        printf("Could not open Inputs.in\n");
+        exit(1);
+    }
+    cdf_size[1] = 0;
+    while(cdf_size[1] < max_cdf_size &&
+          fscanf(infile, "%f", &cdf[1][cdf_size[1] + 1]) == 1)
+        ++cdf_size[1];
+    if(cdf_size[1] == 0 || fscanf(infile, "%f", &extra) == 1) {
+        printf("Inputs.in must hold 1 to %d cdf entries\n", max_cdf_size);
+        exit(1);
+    }
+    fclose(infile);
+
+    for(rep = 0; rep < BENCH_REPEAT; ++rep) {
+        lcgrandst(BENCH_SEED, BENCH_STREAM);
+        sum = 0.0;
+        bench_begin();
+        for(i = 0; i < ops; ++i)
+            sum += empric_cdf(lcgrand(BENCH_STREAM), 1);
+        bench_end();
+        bench_sink = sum;
+    }
+    bench_report("empric_cdf", cdf_size[1], ops);
+}
+
+int main(void)
+{
+    static const long heap_sizes[] = { 10, 1000, 100000 };
+    static const long list_sizes[] = { 10, 1000 };
+    int isize, file_option, remove_option;
+
+    bench_best_time = -1.0;
+    printf("benchmark,size,ops,ns_per_op,allocs_per_op\n");
+
+    for(isize = 0; isize < 3; ++isize) {
+        bench_minheap_fill(heap_sizes[isize], 2000000);
+        bench_minheap_hold(heap_sizes[isize], 1000000);
+        bench_event_hold(heap_sizes[isize], 1000000, 0);
+        bench_event_hold(heap_sizes[isize], 1000000, 1);
+        bench_event_hold(heap_sizes[isize], 1000000, 2);
+        bench_event_hold(heap_sizes[isize], 1000000, 3);
+    }
+
+    for(isize = 0; isize < 2; ++isize)
+        for(file_option = FIRST; file_option <= DECREASING; ++file_option)
+            for(remove_option = FIRST; remove_option <= LAST; ++remove_option)
+                bench_list(file_option, remove_option, list_sizes[isize],
+                           100000);
+
+    bench_sampst(10000000);
+    bench_timest(10000000);
+
+    bench_variate("lcgrand", 1, 10000000);
+    bench_variate("expon", 2, 10000000);
+    bench_variate("erlang_3", 3, 10000000);
+    bench_variate("random_integer_4", 4, 10000000);
+    bench_variate("uniform", 5, 10000000);
+
+    bench_empric_cdf(100000);
+
+    return 0;
+}
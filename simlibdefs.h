@@ -9,7 +9,29 @@
 #define MAX_SVAR    25      /* Max number of sampst variables. */
 #define TIM_VAR     25      /* Max number of timest variables. */
 #define MAX_TVAR    50      /* Max number of timest variables + lists. */
+#define MAX_BVAR    10      /* Max number of batchst variables. */
+#define MAX_PVAR    10      /* Max number of pairst variables. */
+#define MAX_CVAR    10      /* Max number of cvst variables. */
+#define MAX_CONTROL  2      /* Max number of control variates per cvst variable. */
 #define EPSILON      0.001  /* Used in event_cancel. */
+#define TICK_TOLERANCE 0.001 /* Largest distance of an event time from a tick, in ticks (event_ticks). */
+#define SKETCH_BINS  2048   /* Bins per sign in a quantile sketch. */
+#define SKETCH_ALPHA 0.01   /* Relative accuracy of sketch quantiles. */
+#define SKETCH_MIN   1.E-6  /* Smallest magnitude a sketch tells from 0. */
+#define MSER_BATCH   5      /* Observations per batch in MSER warm-up detection. */
+#define MSER_CHECK   100    /* Batches between MSER truncation checks. */
+#define BATCH_SLOTS  64     /* Max batches kept per batchst variable (even). */
+#define BATCH_Z      1.959963985 /* Normal quantile for 95% batchst intervals. */
+#define MAX_REGION  64      /* Max number of model regions in a checkpoint. */
+#define CHECKPOINT_KEY 256  /* Max length of a checkpoint key, with its NUL. */
+#define MAX_STREAM  100     /* Number of lcgrand streams. */
+#define MAX_EVENT_TYPE 25   /* Max event type with its own SIMLIB_PROFILE counters. */
+#define PROFILE_SAMPLE 16   /* SIMLIB_PROFILE reads the clock once every this many calls. */
+#define TRACE_ATTR   4      /* Attributes after the time and type kept per traced event. */
+#define TRACE_STREAMS 5     /* lcgrand streams whose positions are kept per traced event. */
+#define TRACE_BUFFER 4096   /* Traced events written or read in one call. */
+#define MAX_SERIES  16      /* Max number of columns of a time series. */
+#define max_cdf_size 598    /* Max entries in the model's cdf (simulation_code.c and simlib_bench.c). */
 
 /* Define array sizes. */
 
@@ -17,6 +39,19 @@
 #define ATTR_SIZE   11      /* MAX_ATTR + 1. */
 #define SVAR_SIZE   26      /* MAX_SVAR + 1. */
 #define TVAR_SIZE   51      /* MAX_TVAR + 1. */
+#define BVAR_SIZE   11      /* MAX_BVAR + 1. */
+#define PVAR_SIZE   11      /* MAX_PVAR + 1. */
+#define CVAR_SIZE   11      /* MAX_CVAR + 1. */
+
+/* Define subsystems of the memory telemetry. */
+
+#define MEM_CORE     1      /* transfer and the list heads, tails, sizes and ranks. */
+#define MEM_LIST     2      /* List records. */
+#define MEM_EVENT    3      /* The event heap. */
+#define MEM_STAT     4      /* Quantile sketches, MSER batch means and time series. */
+#define MEM_CHECKPOINT 5    /* Buffers of checkpoint_restore. */
+#define MAX_MEM      5      /* Number of subsystems. */
+#define MEM_SIZE     6      /* MAX_MEM + 1. */
 
 /* Define options for list_file and list_remove. */
 
@@ -25,6 +60,11 @@
 #define INCREASING   3      /* Insert in increasing order. */
 #define DECREASING   4      /* Insert in decreasing order. */
 
+/* Define modes for trace_start. */
+
+#define TRACE_RECORD 1      /* Write the events to the trace file. */
+#define TRACE_REPLAY 2      /* Check the events against the trace file. */
+
 /* Define some other values. */
 
 #define LIST_EVENT  25      /* Event list number. */
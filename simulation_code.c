@@ -15,24 +15,88 @@ and a fifth event for policy 3 (FG):
     -Queue Check: In policy 3 (FG), every period we check if there are available servers. If so, we check whether the offline queue should be receiving
     priority. If so, we initiate a callback to the offline queue.
 
+    -Callback Due: Used when callback_mode is 1. A scheduled callback or a window callback reaches its promised time (or the lower bound of its
+    window) and joins the offline queue. If a server is idle, the callback starts right away.
+
+    -Belief Update: Used when online_beliefs is 1. Every belief_update_period periods, the service probabilities pt are estimated from the
+    discounted service counts so far, and the callers' expected waiting times and callback answering probabilities are updated.
+
+    -Renege: Used instead of the Abandon Decision when abandonment_mode is 1. When a caller joins the online queue, the period in which they would
+    abandon is drawn from the same per-period abandonment probabilities, and a single renege event is scheduled for that time. If the caller has
+    been served by then, the event is ignored.
+
 The simulation code allows you to run and record the results of several number of iterations, servers, policies, and guarantee utility multipliers at
 once. All of these choices are below under SIMULATION PARAMETERS.*/
 
 
+#define _POSIX_C_SOURCE 200112L /* Required for fork() and pipe() in branch_mode 1. */
+
 #include "simlib.h"             /* Required for use of simlib.c. */
+#include "call_log.h"           /* Required for call_log_mode 1. */
 #include "assert.h"
 #include "math.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <string.h>
+#include <limits.h>
 
 #define EVENT_ARRIVAL          1  /* Event type for arrival of customer. */
 #define EVENT_DEPARTURE        2  /* Event type for departure of customer after receiving service. */
 #define EVENT_ABANDON_DECISION 3  /* Event type for abandonment decision of customers. */
+#define EVENT_RENEGE           4  /* Event type for a single caller abandoning the online queue (abandonment_mode 1). */
+#define EVENT_CALLBACK_DUE     5  /* Event type for a scheduled or window callback becoming due (callback_mode 1). */
+#define EVENT_BELIEF_UPDATE    6  /* Event type for refreshing pt, EW and cb_answer_prob during the run (online_beliefs 1). */
 
 #define LIST_ONLINE_QUEUE     1  /* List number for online queue. */
 #define LIST_OFFLINE_QUEUE    2  /* List number for offline queue. */
 
+#define VAR_CALLBACKS_PENDING 1  /* timest variable for the number of accepted callbacks not yet due (callback_mode 1). */
+
+#define VAR_ANSWER_ONLINE     1  /* sampst variable (with quantiles) for time-to-answer of online calls, in seconds. */
+#define VAR_ANSWER_OFFLINE    2  /* sampst variable (with quantiles) for time-to-answer of callbacks, in seconds. */
+
+#define BVAR_AWT              1  /* batchst variable for the average waiting time (stopping_mode 1). */
+#define BVAR_ABANDON_RATE     2  /* batchst variable for the abandonment rate (stopping_mode 1). */
+#define BVAR_UTILIZATION      3  /* batchst variable for the server utilization (stopping_mode 1). */
+
 #define STREAM                1  /* Random-number stream*/
+#define STREAM_SEED           1973272912 /* Seed every server count and policy starts STREAM (and the streams skipped from it) from. */
+
+#define STREAM_ARRIVAL        1  /* Stream for the times between a caller's call strings (crn_mode 1 and 2). */
+#define STREAM_SERVICE        2  /* Stream for service times (crn_mode 1 and 2). */
+#define STREAM_CHOICE         3  /* Stream for the callers' choices on arrival (crn_mode 1 and 2). */
+#define STREAM_ABANDON        4  /* Stream for abandonment decisions and renege times (crn_mode 1 and 2). */
+#define STREAM_CALLBACK       5  /* Stream for whether callers answer their callbacks (crn_mode 1 and 2). */
+#define STREAM_SPACING        100000000 /* Draws between the starts of the purpose streams, and before the first caller substream. */
+#define CALLER_SPACING        64 /* Draws between the starts of two callers' substreams (crn_mode 2, at most 255). */
+
+#define CVAR_AWT              1  /* cvst variable for the average waiting time (control_mode 1). */
+#define CVAR_ABANDON_RATE     2  /* cvst variable for the abandonment rate (control_mode 1). */
+
+#define PVAR_AWT              1  /* pairst variable for the average waiting time of antithetic pairs (antithetic_mode 1). */
+#define PVAR_ABANDON_RATE     2  /* pairst variable for the abandonment rate of antithetic pairs (antithetic_mode 1). */
+
+#define PHASE_BELIEFS         1  /* Run phase of estimating pt and finding EW and cb_answer_prob (bench_mode 1). */
+#define PHASE_INIT            2  /* Run phase of initializing simlib and the model (bench_mode 1). */
+#define PHASE_EVENTS          3  /* Run phase of the event loop (bench_mode 1). */
+#define PHASE_RECORD          4  /* Run phase of record() (bench_mode 1). */
+
+#define SERIES_ONLINE_QUEUE      1  /* Time series column of the online queue length (series_mode 1). */
+#define SERIES_OFFLINE_QUEUE     2  /* Time series column of the offline queue length (series_mode 1). */
+#define SERIES_CALLBACKS_PENDING 3  /* Time series column of the callbacks not yet due (series_mode 1). */
+#define SERIES_BUSY_SERVERS      4  /* Time series column of the busy servers (series_mode 1). */
+#define SERIES_CUSTOMERS         5  /* Time series column of the customers done (series_mode 1). */
+#define SERIES_ABANDON_RATE      6  /* Time series column of the abandonment rate so far (series_mode 1). */
+#define SERIES_COLUMNS           6  /* Number of time series columns (series_mode 1). */
+
+#define SNAPSHOT_EVERY      (trace_snapshot>0 ? (long) trace_snapshot : 1L) /* trace_snapshot as a divisor, 1 when there are no snapshots. */
+
+#define DISPATCH_EVENTS     256  /* Events taken from the event list at a time (dispatch_mode 1). */
+#define DISPATCH_WIDTH      11   /* Most values per event record (maxatr + 1) dispatch_events holds (dispatch_mode 1). */
 
-#define max_cdf_size       598 /* This is the maximum number of entries in a cdf.*/
 #define T_max              450 /* This is the maximum number of periods callers believe they will wait in the online queue before receiving service*/
 #define Max_Wait_Minutes 75 /*Maximum number of minutes you can wait*/
 #define n_message_subsets  180  /*Number of message subsets allowed (not including the no message subset).*/
@@ -45,20 +109,147 @@ once. All of these choices are below under SIMULATION PARAMETERS.*/
 /*Choose number of customers and burn-in period*/
 #define Number_of_customers_required 120000 /*2431552*/ /*This is the total number of customers we run through each iteration of the simulation.*/
 #define transient          20000 /*1215776*/ /* However, for gathering statistics we do not consider the calls where their num_custs_delayed is less than this*/
+#define warmup_mode        0 /*0 = discard the first transient customers. 1 = detect the end of the warm-up during the run with MSER-5 on the customers'
+                               waiting times and start gathering statistics there (after Number_of_customers_required/2 customers at the latest).*/
+
+/*Choose when a run stops*/
+#define stopping_mode      0 /*0 = run Number_of_customers_required customers. 1 = after the warm-up, stop as soon as the batch-means 95% confidence
+                               intervals of AWT, abandonment rate and server utilization are all within target_precision of their estimates.*/
+#define target_precision   0.05 /*Target relative half-width of the confidence intervals in stopping_mode 1*/
+#define max_customers_required 1000000 /*In stopping_mode 1, runs stop at this number of customers even if the target precision was not reached*/
+#define stopping_batch     100 /*In stopping_mode 1, number of customers per batch of the AWT, abandonment rate and utilization*/
+
+/*Choose how random numbers are assigned*/
+#define crn_mode           0 /*0 = every random quantity is drawn from STREAM. 1 = arrivals, service times, choices, abandonment and callback answering
+                               each have their own stream (common random numbers), so a policy change only changes the draws of the purposes it
+                               affects. 2 = as 1, and every caller also draws their times between call strings and their service times from their
+                               own substreams, so the same caller gets the same arrival and service draws under every policy.*/
+
+/*Choose whether runs come in antithetic pairs*/
+#define antithetic_mode    0 /*0 = every iteration is a single run. 1 = every run is followed by its antithetic partner, which starts from the same seeds
+                               and replaces every random number u by 1-u. Both rows are written, and the service counts of both runs go into the
+                               next pt. For each server count and policy, the pair averages of AWT and abandonment rate are printed with their
+                               variance and the variance of two independent runs; across iterations these are replications once the beliefs converged.*/
+
+/*Choose whether the policies share the warm-up of a server count*/
+#define branch_mode        0 /*0 = every policy starts from an empty system. 1 = the first iteration of each server count is warmed up once, under
+                               lowest_policy_number, and then forked into one process per policy, which continue from the identical state and
+                               run the remaining iterations of their policy. The rows are written in policy order. warm_start has no effect.*/
+
+/*Choose whether the best policy is selected with a ranking-and-selection procedure*/
+#define selection_mode     0 /*1 = the policies are branched as in branch_mode 1, and in their last iteration, every selection_batch customers after the
+                               warm-up, each remaining policy reports its batch output to the KN fully sequential procedure, which stops the
+                               policies that are worse than another one with confidence 1-selection_alpha. The best policy of each server count is
+                               printed. The rows of the stopped policies cover fewer customers.*/
+#define selection_output   1 /*Output to minimize: 1 = AWT (seconds), 2 = abandonment rate*/
+#define selection_batch    1000 /*Customers per batch in selection_mode 1*/
+#define selection_n0       10 /*Batches of every policy before the first policy can be stopped (at least 2)*/
+#define selection_delta    1.0 /*Indifference zone: differences in the output smaller than this do not matter*/
+#define selection_alpha    0.05 /*The best policy is selected with probability at least 1-selection_alpha*/
+
+/*Choose whether runs share their warm-up through checkpoint files*/
+#define checkpoint_mode    0 /*0 = every run simulates its own warm-up. 1 = once the warm-up of a run is over, its state is saved to
+                               checkpoint_<servers>_<policy>_<iteration>.bin (with _antithetic before .bin for antithetic partners), and the same
+                               run of later executions starts from that file instead, for instance to add a trace, a call log or a time series to a
+                               long run without simulating its warm-up again. Each file is keyed with the run, the seed and the parameters that
+                               shape the run, and a file with another key is refused: delete it, or the ones of every run, to start over. The
+                               key cannot tell a warm_start from a different pt file or a changed Inputs.in apart beyond the service-time mean.*/
+
+/*Choose whether the estimates are corrected with control variates*/
+#define control_mode       0 /*1 = every stopping_batch customers after the warm-up end a batch, and the batch AWT and abandonment rate are regressed
+                               on the batch's mean service time, whose mean is known exactly from the service-time cdf. record() adds the raw
+                               and the adjusted estimates with their standard errors to each row.*/
+
+/*Choose the event list*/
+#define tick_mode          0 /*0 = simlib's binary heap on double event times. 1 = a radix heap on integer ticks of 0.01 periods, since every
+                               event time is a whole number of periods, or 0.01 past one for abandonment decisions and renege events.
+                               Events at the same time are then handled in the order they were scheduled rather than in heap order, so the
+                               results differ from tick_mode 0 only through the order of simultaneous events.*/
+#define dispatch_mode      0 /*0 = the event loop takes one event at a time from the event list. 1 = it takes all the events at the earliest time
+                               at once (up to DISPATCH_EVENTS) with timing_batch and handles them in turn, which with tick_mode 1 costs one pass
+                               over the radix heap per time rather than per event. Events scheduled for the current time while a batch is handled
+                               are taken in the next batch, after it. With tick_mode 1 that is the order timing would take them in, so the
+                               results are the same as without dispatch_mode; with tick_mode 0 they differ through the order of simultaneous
+                               events.*/
+
+/*Choose whether the runs are timed*/
+#define bench_mode         0 /*1 = every run adds a row to Benchmark Report.csv with the events processed, events per second of the event loop, the
+                               largest event list, the peak resident memory of the process, and the time spent on each phase of the run (finding
+                               the beliefs, initializing, the event loop and record()), and simlib's allocations, frees, event heap bytes
+                               and event heap growths. bench_scenarios.sh runs a fixed set of scenarios with it.*/
+
+/*Choose whether the events of each run are traced*/
+#define trace_mode         0 /*0 = no trace. 1 = every run writes the events it handles to trace_<servers>_<policy>_<iteration>.bin (with
+                               _antithetic before .bin for antithetic partners): their time, type, attributes 3 to 6 and the positions of
+                               streams 1 to 5. trace_replay prints them from any event on. 2 = every run is checked event by event against its
+                               trace, the first difference is printed, and the events from trace_from on are printed as they are handled.
+                               With checkpoint_mode 1, a replayed run starts from the saved warm-up and the trace is read from there.*/
+#define trace_from         0 /*In trace_mode 2, number of the first event to print (events are counted from the start of the run)*/
+#define trace_snapshot     0 /*0 = no snapshots. n > 0 = in trace_mode 1, the state of the run is also saved after every n events, to
+                               snapshot_<servers>_<policy>_<iteration>_<event>.bin (with _antithetic before the event number for antithetic
+                               partners), and in trace_mode 2 a run re-runs from the last of its snapshots before event trace_from rather than
+                               from the start, checking the trace from there. A snapshot holds the whole event list, so it can take as much
+                               disk as the run takes memory. The beliefs updated by online_beliefs 1 are not in the snapshots.*/
+
+/*Choose whether every call of each run is logged*/
+#define call_log_mode      0 /*1 = every run writes each call as it ends to calls_<servers>_<policy>_<iteration>.bin (with _antithetic before
+                               .bin for antithetic partners): the caller and their class, arrival time, decision, queue, messages, callback
+                               type, wait, outcome and server. The calls are kept by column and written a block of CALL_LOG_BLOCK at a time,
+                               in the format of call_log.h. call_log prints a log as CSV, so new statistics come from the log instead of
+                               another sweep.*/
+
+/*Choose whether queue and server state is sampled over time*/
+#define series_mode        0 /*1 = every series_interval periods, every run samples the online and offline queue lengths, the callbacks not yet
+                               due, the busy servers, the customers done and the abandonment rate so far (0 until the warm-up is over) into
+                               a buffer allocated when the run starts, and writes it at the end of the run to
+                               series_<servers>_<policy>_<iteration>.csv (with _antithetic before .csv for antithetic partners).*/
+#define series_interval    360 /*Periods between samples in series_mode 1 (360 periods are an hour)*/
+#define series_rows        100000 /*Samples kept per run in series_mode 1. Later samples are dropped with a warning.*/
+
+/*Choose whether long runs report their progress*/
+#define progress_mode      0 /*0 = no progress reports. 1 = every progress_interval seconds, a line on stderr with the customers done out of
+                               customers_required, the simulated time, the events per second, the queue lengths and the estimated time left
+                               for the run and for all runs. 2 = the same line replaces the file Progress.txt, through a rename of a temporary
+                               file of the process, so a reader never sees half of it (in branch_mode 1 and selection_mode 1 the policies'
+                               processes take turns at it).*/
+#define progress_interval  10 /*Seconds between progress reports. The clock is only read every 4096 events.*/
 
 /*Choose number of iterations per policy number/agent number combination*/
 #define n_iter             2 /* This is the number of times to iterate through the simulation. After each iterations /pi(t) and V(t) is updated based on previous service probabilities*/
+#define belief_tolerance   0 /* If greater than 0, stop iterating before n_iter once no pt or cb_answer_prob changes by more than this between iterations
+                               and no EW changes by more than this fraction of itself*/
+#define online_beliefs     0 /* 1 = instead of iterating full runs, update pt, EW and cb_answer_prob every belief_update_period periods of a single run,
+                               from servicenum and atrisk counts that are discounted by belief_decay at each update*/
+#define belief_update_period 1440 /* Periods between belief updates in online_beliefs 1 (1440 periods are 4 hours)*/
+#define belief_decay       0.5 /* Weight the servicenum and atrisk counts keep at each belief update in online_beliefs 1*/
+#define belief_min_support 100 /* Only periods in which at least this many callers were at risk count towards belief_tolerance, since pt is mostly noise in the rest*/
+#define warm_start         0 /* 1 = start the first iteration of each server count from the pt last estimated for the same policy at the previous
+                               server count, instead of from zeros*/
 
 /*Choose how many servers to test for each policy number*/
 #define lowest_n_servers   50 /*This is the lowest number of servers you want to test in the simulations*/
 #define highest_n_servers  50 /*This is the highest number of servers you want to test in the simulations*/
 #define server_jump        4   /*When you loop through the number of servers, this is how many servers you want to jump by*/
+#define staffing_mode      0 /*0 = simulate every server count from lowest_n_servers to highest_n_servers. 1 = for each policy, bisect over the same
+                               server counts for the smallest one whose staffing_output meets staffing_target, judging each run by its batch means
+                               (of stopping_batch customers), and print that server count with the 95% confidence intervals that decided it*/
+#define staffing_output    2 /*Output compared with staffing_target in staffing_mode 1: 1 = AWT (seconds), 2 = abandonment rate*/
+#define staffing_target    0.05 /*Largest acceptable value of staffing_output in staffing_mode 1*/
 
 /*Now come the policy choices, where policy 1 is policy N (No Callbacks), 2 is policy SQ (Status Quo), 3 is policy FG (Fixed Guarantee) and 4 is policy W (Window)*/
 /*Choose which policies to simulate*/
 #define lowest_policy_number 1 /* This is the lowest policy number you want to test in the simulations.*/
 #define highest_policy_number 1 /* This is the highest policy number you want to test in the simulations.*/
 
+/*Choose how abandonment from the online queue is simulated*/
+#define abandonment_mode   0 /*0 = every period, each caller in the online queue decides whether to abandon. 1 = when a caller joins the online queue,
+                               the period they abandon in is drawn once from the same per-period probabilities and a single renege event is scheduled.*/
+
+/*Choose how scheduled and window callbacks wait for their promised time*/
+#define callback_mode      0 /*0 = they wait in the offline queue and are checked whenever a server departs. 1 = each accepted callback schedules a
+                               callback due event at its promised time (or window lower bound) and only then joins the offline queue, so an idle
+                               server starts it right away.*/
+
 /*Policy parameters for policy 4 (Window policy)*/
 #define MID  30 /*Just for reference, the middle point of LB and UB*/
 #define LB   20 /* This is the lower bound for the callback window in policy W*/
@@ -78,10 +269,16 @@ float cdf[1+1][1+max_cdf_size], cdf_value;
 float queue_length_online, queue_length_offline;
 float temp, temp_time;
 float v0, v1, v2;
-float atrisk[1+n_message_subsets][1+2][1+T_max], servicenum[1+n_message_subsets][1+2][1+T_max], pt[1+n_message_subsets][1+2][1+T_max]; /*1 is online, 2 is offline*/
+float atrisk[1+n_message_subsets][1+2][1+T_max], servicenum[1+n_message_subsets][1+2][1+T_max], pt[1+n_message_subsets][1+2][2+T_max]; /*1 is online, 2 is offline. pt has room for pt[..][..][T_max+1]=1*/
 float req_wait_cdf[1+n_message_subsets][1+2][1+T_max], req_wait_pdf[1+n_message_subsets][1+2][1+T_max], EW[1+n_message_subsets][1+2][1+T_max]; /*1 is online, 2 is offline*/
 float server_intime[1+max_servers], server_outtime[1+max_servers], server_util[1+max_servers], server_util_sum, server_util_total, server_busy_time[1+max_servers];
 float cb_answer_prob[1+n_message_subsets][2]; /*0 is day and 1 is evening*/
+float pt_prev[1+n_message_subsets][1+2][2+T_max], EW_prev[1+n_message_subsets][1+2][1+T_max], cb_answer_prob_prev[1+n_message_subsets][2]; /*Beliefs of the previous iteration*/
+float pt_support[1+n_message_subsets][1+2][1+T_max]; /*Number of callers at risk behind each pt estimate*/
+float pt_solved[1+N_Policies][1+n_message_subsets][1+2][2+T_max]; /*Last pt estimated for each policy, for warm_start*/
+int   pt_solved_available[1+N_Policies];
+float belief_change; /*Largest change in the beliefs between two iterations*/
+int   beliefs_converged;
 float avg_service_time;
 float abandon_prob;
 float still_looping;
@@ -89,7 +286,20 @@ float starttime, wait_time[1+2], wait_time_total, AWT[1+2], AWT_total, calls_rec
 calls_answered[1+2], calls_answered_total,calls_abandoned, callbacks_not_answered, calls_not_serviced, abandon_rate,
 callback_not_answer_rate, no_service_rate, avg_queue_length_total,avg_queue_length[3], callbacks_offered, callbacks_accepted,
 percent_accept_callback, percent_answer_callback, AWT_All, Throughput, Rho_On, Rho_All;
+float p90_answer[1+2], p99_answer[1+2]; /*Tail percentiles of time-to-answer in seconds, 1 is online, 2 is offline*/
 float last_online_wait_time;
+int warmup_customers; /*Statistics are gathered once num_custs_delayed reaches this. Equal to transient unless warmup_mode is 1.*/
+int precision_reached;
+int customers_required; /*The run stops once num_custs_delayed reaches this. Lowered in stopping_mode 1 once the target precision is reached.*/
+double sum_wait_time, sum_calls_received, sum_calls_received_online, sum_calls_abandoned, sum_busy_time; /*Waiting time, calls received (all and online),
+calls abandoned and busy time of the departed callers so far, in double: the batch outputs are differences of these totals, and in float each addition to
+a large total would round away a noticeable part of a single wait*/
+double batch_wait_time, batch_calls_received, batch_calls_received_online, batch_calls_abandoned, batch_busy_time, batch_start; /*Totals at the start of the current batch*/
+double service_mean; /*Exact mean service time, the known mean of the control variate*/
+double service_total, services_started; /*Service time drawn and services started so far*/
+double batch_service_total, batch_services; /*The same at the start of the current batch*/
+double cv_controls[MAX_CONTROL], cv_means[MAX_CONTROL]; /*Control observations of a batch, and their known means*/
+float awt_cv[1+4], abandon_rate_cv[1+4]; /*Raw and adjusted estimates with their standard errors (control_mode 1)*/
 float LB_periods, UB_periods;
 int Evening; /*Indicator that call is in evening*/
 int Online_Message_Index[1+Max_Wait_Minutes][1+N_Policies]; /*This looks up what online message will be given to the caller given the predicted online wait and policy number.*/
@@ -124,15 +334,124 @@ float p_s[1+N_Latent_Classes], lambda_s[1+N_Latent_Classes], r[1+N_Latent_Classe
 /*Availability Probabilities*/
 float avail_prob[1+Max_Wait_Minutes][2];
 
+/*Abandonment (abandonment_mode 1)*/
+float abandon_survival[1+N_Latent_Classes][1+n_message_subsets][1+T_max]; /*Probability that a caller is still in the online queue after each period, by class and message*/
+float abandon_hazard_tail[1+N_Latent_Classes][1+n_message_subsets]; /*Per-period abandonment probability after T_max periods*/
+int renege_ticket[1+N_Callers]; /*Incremented every time a caller joins the online queue, so renege events left over from an earlier visit are ignored*/
+
+/*Callbacks (callback_mode 1)*/
+int callbacks_pending; /*Number of accepted scheduled or window callbacks that are not yet due*/
+float callback_due_time;
+
+/*Common random numbers (crn_mode 2)*/
+long (*caller_seed)[1+2]; /*Next seed of each caller's substream, for STREAM_ARRIVAL and STREAM_SERVICE (1+N_Callers rows, allocated in crn_mode 2)*/
+unsigned char (*caller_draws)[1+2]; /*Draws taken from each caller's substreams since reset_streams, at most CALLER_SPACING (allocated in crn_mode 2)*/
+
+/*Antithetic pairs (antithetic_mode 1)*/
+int antithetic_run; /*0 for the first run of a pair, 1 for its antithetic partner*/
+long pair_seed[1+STREAM_CALLBACK]; /*Seeds the first run of the pair started from*/
+long (*pair_caller_seed)[1+2]; /*Caller seeds the first run of the pair started from (allocated in crn_mode 2)*/
+unsigned char (*pair_caller_draws)[1+2]; /*Caller draws the first run of the pair started from (allocated in crn_mode 2)*/
+
+/*Checkpoints (checkpoint_mode 1)*/
+char checkpoint_file[64];
+char checkpoint_id[CHECKPOINT_KEY]; /*Key of the run's checkpoint: the run, the seed and the parameters that shape the run*/
+int checkpoint_saved; /*Indicator that this run already has its warmed-up state in checkpoint_file*/
+
+/*Event traces (trace_mode 1 and 2)*/
+char trace_file[80];
+char snapshot_file[96]; /*State of the run after a number of events (trace_snapshot > 0)*/
+long snapshot; /*Event number of the snapshot to re-run from in trace_mode 2*/
+
+/*Per-call logs (call_log_mode 1). The calls of the current block are kept by column, as they are written.*/
+char call_log_file[80];
+FILE *call_log;
+struct call_log_header call_log_header;
+long call_log_rows; /*Calls in the current block*/
+int call_log_caller[CALL_LOG_BLOCK];
+signed char call_log_class[CALL_LOG_BLOCK], call_log_decision[CALL_LOG_BLOCK], call_log_queue[CALL_LOG_BLOCK];
+signed char call_log_callback_type[CALL_LOG_BLOCK], call_log_outcome[CALL_LOG_BLOCK];
+short call_log_online_message[CALL_LOG_BLOCK], call_log_offline_message[CALL_LOG_BLOCK], call_log_server[CALL_LOG_BLOCK];
+double call_log_arrival[CALL_LOG_BLOCK];
+float call_log_wait[CALL_LOG_BLOCK];
+
+/*Time series (series_mode 1)*/
+const char *series_names[1+SERIES_COLUMNS] = {"", "Online_Queue", "Offline_Queue", "Callbacks_Pending", "Busy_Servers", "Customers", "Abandon_Rate"};
+
+/*Branching (branch_mode 1)*/
+int branch_pending; /*Indicator that this run forks into the policies once the warm-up is over*/
+int branch_child; /*Indicator that this process runs a single policy that branched off*/
+int branch_done; /*Indicator that the policies of this server count were run by the branched processes*/
+
+/*Staffing search (staffing_mode 1). Server counts are indexed by their step from lowest_n_servers.*/
+int staffing_low[1+N_Policies], staffing_high[1+N_Policies]; /*The smallest acceptable index is above staffing_low and at most staffing_high*/
+int staffing_tested[1+N_Policies][1+max_servers]; /*Indicator that the index was simulated for the policy*/
+double staffing_mean[1+N_Policies][1+max_servers], staffing_halfwidth[1+N_Policies][1+max_servers]; /*Batch-means estimate and 95% half-width of staffing_output*/
+
+/*Ranking and selection (selection_mode 1)*/
+int selection_active; /*Indicator that this run reports its batch outputs to the selection procedure*/
+int selection_obs_fd, selection_cmd_fd; /*Pipes to and from the selection procedure in a branched process*/
+double selection_wait_time, selection_calls_received, selection_calls_received_online, selection_calls_abandoned; /*Totals at the start of the current batch*/
+
+/*Run timing (bench_mode 1)*/
+double phase_clock, phase_time[1+PHASE_RECORD]; /*Time of the last phase change, and seconds spent in each phase of the current run*/
+FILE  *benchfile; /*Benchmark Report.csv*/
+
+/*Progress reports (progress_mode 1 and 2)*/
+double progress_start, progress_run_start, progress_clock; /*Clock at the start of the program, at the start of the run's events and at the last report*/
+long progress_events; /*events_processed at the last report*/
+
+/*Batched dispatch (dispatch_mode 1)*/
+double dispatch_events[DISPATCH_EVENTS*DISPATCH_WIDTH]; /*Records of the events at the current time, from timing_batch*/
+int dispatch_count, dispatch_next; /*Events in dispatch_events, and the one being handled*/
+int runs_planned; /*Runs in the full sweep (fewer if iterations stop early or in staffing_mode 1)*/
+
 FILE  *infile, *outfile;
 
 /* Declare non-simlib functions. */
 void init_model(void); /*The subroutine for initializing the model*/
 void arrive(void);     /*The subroutine for arrival of new customer.*/
 void depart(int depart_server); /*The subroutine for departure of serviced customer*/
+void serve_next(int free_server); /*The subroutine for deciding which caller a free server serves next*/
+int  find_idle_server(void); /*The subroutine for picking the server that has been idle the longest*/
+void file_callback(void); /*The subroutine for placing a caller who accepted a callback into the offline queue*/
+void callback_due(void); /*The subroutine for a scheduled or window callback becoming due (callback_mode 1)*/
 void abandon_decision(void); /*The subroutine for determining whether customers abandoned in the period*/
+void abandon(void); /*The subroutine for a caller abandoning the online queue*/
+void build_abandon_table(void); /*The subroutine for tabulating online queue survival probabilities (abandonment_mode 1)*/
+void schedule_renege(void); /*The subroutine for scheduling the renege event of a caller joining the online queue (abandonment_mode 1)*/
+void renege(void); /*The subroutine for a caller's renege event (abandonment_mode 1)*/
 void record(void); /*The subroutine for recording the statistics into .csv file*/
+void estimate_pt(void); /*The subroutine for estimating the service probabilities pt from the servicenum and atrisk trackers*/
+void compute_beliefs(void); /*The subroutine for finding EW and cb_answer_prob from pt*/
+void update_beliefs(void); /*The subroutine for refreshing the beliefs during the run (online_beliefs 1)*/
+void compare_beliefs(void); /*The subroutine for measuring how much pt, EW and cb_answer_prob changed since the previous iteration*/
+void customer_done(float wait); /*The subroutine for counting a customer who has been served, abandoned or missed their callback*/
+void log_call(int queue, int outcome, int server, float wait); /*The subroutine for adding a call that ended to the call log (call_log_mode 1)*/
+void call_log_start(void); /*The subroutine for opening the call log of a run (call_log_mode 1)*/
+void call_log_write(void); /*The subroutine for writing the calls of the current block to the call log (call_log_mode 1)*/
+void call_log_stop(void); /*The subroutine for writing the last block and closing the call log of a run (call_log_mode 1)*/
+void sample_series(void); /*The subroutine for taking the time series samples that are due (series_mode 1)*/
+void write_series(void); /*The subroutine for writing the time series of a run (series_mode 1)*/
+void check_precision(void); /*The subroutine for ending a batch and checking whether the target precision has been reached (stopping_mode 1, control_mode 1 and staffing_mode 1)*/
+void branch_policies(void); /*The subroutine for forking the warmed-up run into one process per policy (branch_mode 1 and selection_mode 1)*/
+int start_n_servers(void); /*The subroutine for the first server count to simulate*/
+int next_n_servers(void); /*The subroutine for the next server count to simulate, or one beyond highest_n_servers once there is none*/
+int staffing_next(int policy); /*The subroutine for the next server count the staffing search of a policy needs, or 0 once it is done (staffing_mode 1)*/
+void staffing_update(void); /*The subroutine for narrowing the staffing search of the current policy with the run just finished (staffing_mode 1)*/
+void report_staffing(void); /*The subroutine for printing the result of the staffing searches (staffing_mode 1)*/
+void select_policy(int obs_fd[], int cmd_fd[]); /*The subroutine for the ranking-and-selection procedure over the branched policies (selection_mode 1)*/
+void selection_batch_done(void); /*The subroutine for reporting a batch output to the selection procedure (selection_mode 1)*/
+void register_state(void); /*The subroutine for telling simlib which model variables make up the state of a run (checkpoint_mode 1)*/
 int  empric_cdf(float cdf_value, int arr_sev_no); /*The subroutine for drawing value for empirical distribution*/
+void reset_streams(void); /*The subroutine for resetting the random numbers*/
+int  stream_for(int purpose, int caller); /*The subroutine for choosing the stream of a single draw for a purpose*/
+void pair_streams(int antithetic); /*The subroutine for starting both runs of an antithetic pair from the same seeds (antithetic_mode 1)*/
+void report_pairs(void); /*The subroutine for printing the statistics of the antithetic pairs (antithetic_mode 1)*/
+double wall_clock(void); /*The subroutine for reading the wall clock in seconds*/
+void report_progress(void); /*The subroutine for writing a progress report if progress_interval has passed (progress_mode 1 and 2)*/
+void bench_phase(int phase); /*The subroutine for charging the time since the last phase change to a phase of the run (bench_mode 1)*/
+void bench_record(void); /*The subroutine for writing the timing row of a run (bench_mode 1)*/
 
 /*******************************************************************************************/
 
@@ -276,8 +595,40 @@ int main()  /* Main function. */
         fscanf(infile,"%f", &cdf[1][i]);
     }
 
+    /*Exact mean of the empirical service time distribution, the known mean of the control variate*/
+    service_mean=0;
+    for (i=1; i<=cdf_size[1]; ++i){
+        service_mean=service_mean+(i-1)*(cdf[1][i]-cdf[1][i-1]);
+    }
+
     /*Set iteration count for counting number of simulations we've run*/
     iteration_count=0;
+    /*A trace or a call log belongs to one process*/
+    if ((trace_mode>0 || call_log_mode==1) && (branch_mode==1 || selection_mode==1)){
+        printf("trace_mode and call_log_mode cannot be combined with branch_mode 1 or selection_mode 1, whose branched processes share the run\n");
+        exit(1);
+    }
+
+    /*The callers' substreams take memory for every caller, so they only exist when they are used*/
+    if (crn_mode==2){
+        caller_seed = malloc((1+N_Callers)*sizeof(*caller_seed));
+        caller_draws = malloc((1+N_Callers)*sizeof(*caller_draws));
+        if (caller_seed==NULL || caller_draws==NULL){
+            printf("Not enough memory for the caller substreams of crn_mode 2\n");
+            exit(1);
+        }
+        if (antithetic_mode==1){
+            pair_caller_seed = malloc((1+N_Callers)*sizeof(*pair_caller_seed));
+            pair_caller_draws = malloc((1+N_Callers)*sizeof(*pair_caller_draws));
+            if (pair_caller_seed==NULL || pair_caller_draws==NULL){
+                printf("Not enough memory for the caller substreams of antithetic pairs in crn_mode 2\n");
+                exit(1);
+            }
+        }
+    }
+
+    runs_planned=((highest_n_servers-lowest_n_servers)/server_jump+1)*(highest_policy_number-lowest_policy_number+1)*n_iter*(1+antithetic_mode);
+    progress_start=wall_clock();
 
     /*Open output file, which is a .csv where we collect the simulation statistics*/
 	outfile = fopen("Simulation Statistics.csv", "w");
@@ -285,18 +636,39 @@ int main()  /* Main function. */
     fprintf(outfile,"CALLS_RECEIVED(Online),CALLS_RECEIVED(Offline),CALLS_RECEIVED(All),CALLS_ANSWERED(Online),CALLS_ANSWERED(Offline),");
     fprintf(outfile,"CALLS_ANSWERED(All),CALLS_ABANDONED(Online),CALLBACKS_NOT_ANSWERED(Offline),CALLS_NOT_SERVICED(All),ABANDON_RATE(Online),");
     fprintf(outfile,"CALLBACK_NOT_ANSWER_RATE(Offline),NO_SERVICE_RATE(All),AVG_QUEUE_LENGTH(Online),AVG_QUEUE_LENGTH(Offline),AVG_QUEUE_LENGTH(All),");
-    fprintf(outfile,"SERVER_UTILIZATION,Sim_Time,Percent_Accepting_Callback,Percent_Answering_Callback\n");
+    fprintf(outfile,"SERVER_UTILIZATION,Sim_Time,Percent_Accepting_Callback,Percent_Answering_Callback,");
+    fprintf(outfile,"P90_TIME_TO_ANSWER(Online),P99_TIME_TO_ANSWER(Online),P90_TIME_TO_ANSWER(Offline),P99_TIME_TO_ANSWER(Offline)");
+    if (control_mode==1){
+        fprintf(outfile,",AWT_RAW,AWT_RAW_SE,AWT_CV,AWT_CV_SE,ABANDON_RATE_RAW,ABANDON_RATE_RAW_SE,ABANDON_RATE_CV,ABANDON_RATE_CV_SE");
+    }
+    fprintf(outfile,"\n");
+
+    /*In bench_mode 1, open the timing report. Rows are written whole, so branched processes can share it.*/
+    if (bench_mode==1){
+        benchfile = fopen("Benchmark Report.csv", "w");
+        if (benchfile == NULL) {
+            fprintf(stderr, "Could not open Benchmark Report.csv.");
+            exit(1);
+        }
+        setvbuf(benchfile, NULL, _IOLBF, BUFSIZ);
+        fprintf(benchfile,"Servers,Policy,Iteration,Events,Events_per_sec,Peak_Event_List,Peak_RSS_KB,Beliefs_Time,Init_Time,Event_Loop_Time,Record_Time,Allocs,Frees,Event_Heap_Bytes,Event_Heap_Growths\n");
+    }
 
 
     /*We iterate through different number of servers in the system*/
-    for (n_servers=lowest_n_servers; n_servers<=highest_n_servers; n_servers = n_servers + server_jump){
+    for (n_servers=start_n_servers(); n_servers<=highest_n_servers; n_servers = next_n_servers()){
 
         /*Reset the random numbers*/
-        lcgrandst(1973272912,1);
+        reset_streams();
 
     /*We iterate through the different policies*/
     for (policy_number=lowest_policy_number; policy_number<=highest_policy_number; ++policy_number){
 
+        /*In staffing_mode 1, only the policies whose search needs this server count are simulated*/
+        if (staffing_mode==1 && staffing_next(policy_number)!=n_servers){
+            continue;
+        }
+
         /*Reset the service probabilities to be a vector of zeros*/
         for (i=0; i<=n_message_subsets; ++i){
             for (j=1; j<=2; ++j){
@@ -318,42 +690,47 @@ int main()  /* Main function. */
         }
 
         /*Reset the random numbers*/
-        lcgrandst(1973272912,1);
+        reset_streams();
+
+        beliefs_converged = 0;
+
+        /*Start the antithetic pair statistics of this policy*/
+        pairst(0.0, 0);
 
     /*We iterate through the predetermined number of iterations.*/
     for (iter=1; iter<=n_iter; ++iter){
 
         printf("Servers = %d, Policy = %d, Iteration %d\n",n_servers,policy_number,iter); /*Print which iteration we're on*/
 
+        bench_phase(0);
+
         /*At the beginning of each iteration we update the service probabilities (pt) and value function using the empirical distribution of service probabilities
         from the previous iteration. For the first iteration, we assume all service probabilities are zero.*/
 
         /*BEGIN BLOCK*/
         /*In this block we update the service probabilities pt for each message subset.*/
-        if (iter==1){
+        if (iter==1 && warm_start==1 && pt_solved_available[policy_number]==1){
+            /*Warm start from the pt of the previous server count*/
             for (i=0; i<=n_message_subsets; ++i){
                 for (j=1; j<=2; ++j){ /*1 is online and 2 is offline*/
-                    for (k=1; k<=T_max; ++k){
-                        pt[i][j][k]=0; /*Message, queue, period*/
+                    for (k=1; k<=T_max+1; ++k){
+                        pt[i][j][k]=pt_solved[policy_number][i][j][k];
                     }
-                    pt[i][j][T_max+1] = 1;
                 }
             }
-        }
-
-        if (iter>=2){
+        }else if (iter==1){
             for (i=0; i<=n_message_subsets; ++i){
                 for (j=1; j<=2; ++j){ /*1 is online and 2 is offline*/
                     for (k=1; k<=T_max; ++k){
-                        if (servicenum[i][j][k]>0){
-                            pt[i][j][k]=servicenum[i][j][k]/atrisk[i][j][k];
-                        }else{
-                            pt[i][j][k]=0;
-                        }
+                        pt[i][j][k]=0; /*Message, queue, period*/
                     }
-                    pt[i][j][T_max+1]=1;
+                    pt[i][j][T_max+1] = 1;
                 }
             }
+        }
+
+        if (iter>=2){
+            estimate_pt();
 
             /*Clear out the servicenum and atrisk trackers*/
             for (i=0; i<=n_message_subsets; ++i){
@@ -379,73 +756,25 @@ int main()  /* Main function. */
 
         /*END BLOCK*/
 
-        /*BEGIN BLOCK*/
-        /*In this block we find the expected waiting times given the message, the period, and the channel.*/
-
-        /*FIRST, REQUIRED WAITING TIME CDF*/
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                req_wait_cdf[i][j][1] = pt[i][j][1];
-            }
-        }
-
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                for (k=2; k<=T_max; ++k){
-                    req_wait_cdf[i][j][k] = req_wait_cdf[i][j][k-1]+(1-req_wait_cdf[i][j][k-1])*pt[i][j][k];
-                }
-            }
-        }
-
-
-        /*SECOND, REQUIRED WAITING TIME PDF*/
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                req_wait_pdf[i][j][1] = req_wait_cdf[i][j][1];
-            }
-        }
-
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                for (k=2; k<=T_max; ++k){
-                    req_wait_pdf[i][j][k] = req_wait_cdf[i][j][k]-req_wait_cdf[i][j][k-1];
-                }
-            }
-        }
+        /*Find the expected waiting times and callback answering probabilities implied by pt*/
+        compute_beliefs();
 
-        /*THIRD, EXPECTED WAITING TIME*/
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                for (l=1; l<=T_max; ++l){
-                    EW[i][j][1] = EW[i][j][1] + l*req_wait_pdf[i][j][l];
-                }
+        /*If the beliefs hardly changed, the previous iteration was already run with converged beliefs, so stop here*/
+        if (belief_tolerance>0){
+            compare_beliefs();
+            if (iter>=2 && belief_change<=belief_tolerance){
+                printf("Beliefs converged after %d iterations (largest change %g)\n",iter-1,belief_change);
+                beliefs_converged = 1;
+                break;
             }
         }
+        bench_phase(PHASE_BELIEFS);
 
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=1; j<=2; ++j){
-                for (k=2; k<=T_max; ++k){
-                    for (l=k; l<=T_max; ++l){
-                        if(req_wait_cdf[i][j][l]<1){
-                            EW[i][j][k] = EW[i][j][k] + (l-k+1)*req_wait_pdf[i][j][l]/(1-req_wait_cdf[i][j][k-1]);
-                        }else{
-                            EW[i][j][k] = EW[i][j][k] + 0;
-                        }
-                    }
-                }
-            }
-        }
+    /*In antithetic_mode 1, the run is repeated from the same seeds with antithetic random numbers*/
+    for (antithetic_run=0; antithetic_run<=antithetic_mode; ++antithetic_run){
 
-        /*BEGIN BLOCK*/
-        /*In this block we find the callback answering probabilities by message by day/evening given the availability probabilities and
-        waiting time distribution in the offline queue for each offline message*/
-        for (i=0; i<=n_message_subsets; ++i){
-            for (j=0; j<=1; ++j){ /*Day and Evening*/
-                for (k=1; k<=T_max; ++k){
-                    offline_message_minute = ceil(k/periods_per_minute);
-                    cb_answer_prob[i][j]=cb_answer_prob[i][j]+req_wait_pdf[i][2][k]*avail_prob[offline_message_minute][j];
-                }
-            }
+        if (antithetic_mode==1){
+            pair_streams(antithetic_run);
         }
 
         /*Number of times we've done a simulation*/
@@ -463,143 +792,834 @@ int main()  /* Main function. */
         /* Set maxatr = max(maximum number of attributes per record, 4) */
         maxatr = 10;  /* NEVER SET maxatr TO BE SMALLER THAN 4. */ /*BACK*/
 
+        /*In dispatch_mode 1, timing_batch places maxatr + 1 values per event in dispatch_events*/
+        if (dispatch_mode==1 && maxatr+1>DISPATCH_WIDTH){
+            printf("\nmaxatr %d needs %d values per event, but dispatch_events holds %d (DISPATCH_WIDTH)\n",maxatr,maxatr+1,DISPATCH_WIDTH);
+            exit(1);
+        }
+
+        /*In tick_mode 1, keep the events on ticks of 0.01 periods*/
+        if (tick_mode==1){
+            event_ticks(0.01);
+        }
+
         /*In policy SQ, we want the offline callers placed in queue in order of their expected callback time.
         We use transfer[9] to record their expected callback time at the time of their offer.*/
         list_rank[LIST_OFFLINE_QUEUE] = 9;
 
-        /* Initialize the model. */
-        init_model();
+        /*Keep quantile sketches of the time-to-answer, for the tail percentiles in record()*/
+        sampst_quantiles(VAR_ANSWER_ONLINE);
+        sampst_quantiles(VAR_ANSWER_OFFLINE);
+
+        /* Initialize the model. In checkpoint_mode 1, a run that was warmed up by an earlier execution starts from the saved state instead,
+        and in trace_mode 2 with trace_snapshot>0, a run re-runs from its last snapshot before event trace_from.*/
+        checkpoint_saved = 0;
+        if (checkpoint_mode==1 || trace_snapshot>0){
+            register_state();
+            sprintf(checkpoint_id,"servers %d policy %d iteration %d/%d%s seed %ld callers %ld customers %d transient %d modes %d%d%d%d%d%d%d%d%d precision %g/%d beliefs %d/%g/%d service mean %.9g",
+                n_servers,policy_number,iter,n_iter,antithetic_run==1 ? " antithetic" : "",(long) STREAM_SEED,(long) N_Callers,
+                Number_of_customers_required,transient,warmup_mode,stopping_mode,crn_mode,control_mode,tick_mode,abandonment_mode,
+                callback_mode,online_beliefs,warm_start,target_precision,stopping_batch,belief_update_period,belief_decay,
+                belief_min_support,service_mean);
+            checkpoint_key(checkpoint_id);
+        }
+        if (trace_mode==2 && trace_snapshot>0){
+            for (snapshot=(trace_from-1)/SNAPSHOT_EVERY*SNAPSHOT_EVERY; snapshot>0 && checkpoint_saved==0; snapshot=snapshot-SNAPSHOT_EVERY){
+                sprintf(snapshot_file,"snapshot_%d_%d_%d%s_%ld.bin",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "",snapshot);
+                checkpoint_saved = checkpoint_restore(snapshot_file);
+            }
+            if (checkpoint_saved==1){
+                printf("Re-running from %s\n",snapshot_file);
+            }
+        }
+        if (checkpoint_mode==1){
+            sprintf(checkpoint_file,"checkpoint_%d_%d_%d%s.bin",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "");
+            if (checkpoint_saved==0){
+                checkpoint_saved = checkpoint_restore(checkpoint_file);
+            }
+        }
+        if (checkpoint_saved==0){
+            init_model();
+        }
+        bench_phase(PHASE_INIT);
+        /*In trace_mode 1 and 2, record the events of this run, or check them against the recorded ones*/
+        if (trace_mode>0){
+            sprintf(trace_file,"trace_%d_%d_%d%s.bin",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "");
+            trace_start(trace_file, trace_mode, trace_from);
+        }
+        if (call_log_mode==1){
+            call_log_start();
+        }
+        if (series_mode==1){
+            series_start(series_interval, SERIES_COLUMNS, series_rows);
+        }
+
+        progress_run_start = wall_clock();
+        progress_clock = progress_run_start;
+        progress_events = events_processed;
+
+        /*In branch_mode 1, the first run of a server count branches into the policies*/
+        branch_pending = ((branch_mode==1 || selection_mode==1) && branch_child==0 && iter==1);
+
+        /*In selection_mode 1, the last iteration of a branched policy reports to the selection procedure*/
+        selection_active = (selection_mode==1 && branch_child==1 && (iter==n_iter || online_beliefs==1));
 
         /* Run the simulation until reaching the required number of customers. */
-        while (num_custs_delayed < Number_of_customers_required) {
+        while (num_custs_delayed < customers_required) {
+
+            /* Determine the next event, or in dispatch_mode 1 all the events at the next time. */
+            if (dispatch_mode==1){
+                dispatch_count = timing_batch(dispatch_events, DISPATCH_EVENTS);
+            }else{
+                timing();
+                dispatch_count = 1;
+            }
 
-            /* Determine the next event. */
-            timing();
+            /*In series_mode 1, sample the state before the event if a sample is due*/
+            if (series_mode==1){
+                sample_series();
+            }
 
-            switch (next_event_type) {
+            for (dispatch_next=0; dispatch_next<dispatch_count && num_custs_delayed<customers_required; ++dispatch_next){
 
-                case EVENT_ARRIVAL:
-                    arrive();
-                    break;
+                /*timing_batch leaves the first event in transfer; load the others in turn*/
+                if (dispatch_next>0){
+                    memcpy(transfer, dispatch_events+dispatch_next*(maxatr+1), sizeof(double)*(maxatr+1));
+                    next_event_type = (int) transfer[EVENT_TYPE];
+                }
 
-                case EVENT_DEPARTURE:
-                    depart( (int) transfer[3] );
-                    break;
+                switch (next_event_type) {
+
+                    case EVENT_ARRIVAL:
+                        arrive();
+                        break;
+
+                    case EVENT_DEPARTURE:
+                        depart( (int) transfer[3] );
+                        break;
+
+                    case EVENT_ABANDON_DECISION:
+                        abandon_decision();
+                        break;
+
+                    case EVENT_RENEGE:
+                        renege();
+                        break;
+
+                    case EVENT_CALLBACK_DUE:
+                        callback_due();
+                        break;
+
+                    case EVENT_BELIEF_UPDATE:
+                        update_beliefs();
+                        break;
+                }
+            }
+
+            /*Events of the batch left unhandled when the run ends are not counted as processed*/
+            events_processed -= dispatch_count-dispatch_next;
+
+            /*In progress_mode 1 and 2, check every 4096 events whether a progress report is due*/
+            if (progress_mode>0 && ((events_processed-dispatch_next)>>12)!=(events_processed>>12)){
+                report_progress();
+            }
+
+            /*In trace_mode 1 with trace_snapshot>0, save the state after every trace_snapshot events, for replays to re-run from*/
+            if (trace_mode==1 && trace_snapshot>0 && events_processed%SNAPSHOT_EVERY==0){
+                sprintf(snapshot_file,"snapshot_%d_%d_%d%s_%ld.bin",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "",events_processed);
+                checkpoint_save(snapshot_file);
+            }
+
+            /*In checkpoint_mode 1, save the state between two events once the warm-up is over*/
+            if (checkpoint_mode==1 && checkpoint_saved==0 && num_custs_delayed>=warmup_customers){
+                checkpoint_save(checkpoint_file);
+                checkpoint_saved = 1;
+            }
 
-                case EVENT_ABANDON_DECISION:
-                    abandon_decision();
+            /*In branch_mode 1, fork the policies between two events once the warm-up is over*/
+            if (branch_pending==1 && num_custs_delayed>=warmup_customers){
+                branch_policies();
+                if (branch_done==1){
                     break;
+                }
             }
         }
 
+        bench_phase(PHASE_EVENTS);
+        if (trace_mode>0){
+            trace_stop();
+        }
+        if (call_log_mode==1){
+            call_log_stop();
+        }
+        if (series_mode==1 && branch_done==0){
+            write_series();
+        }
+
+        /*The branched processes finish the run*/
+        if (branch_done==1){
+            break;
+        }
+
     record(); /*Record statistics in the .csv file.*/
+        bench_phase(PHASE_RECORD);
+        bench_record();
+
+        /*Pool the estimates of the two runs of an antithetic pair*/
+        if (antithetic_mode==1){
+            pairst(AWT_total, PVAR_AWT);
+            pairst(abandon_rate, PVAR_ABANDON_RATE);
+        }
+    } /*Closing the loop for antithetic_run*/
+
+        if (branch_done==1){
+            break;
+        }
+
+        /*With online beliefs, the single run replaces the iterations*/
+        if (online_beliefs==1){
+            break;
+        }
     } /*Closing the loop for guarantee utility multiplier*/
+
+        /*Narrow the staffing search of this policy with the last run*/
+        if (staffing_mode==1){
+            staffing_update();
+        }
+
+        /*Report the antithetic pairs of this server count and policy*/
+        if (antithetic_mode==1){
+            report_pairs();
+        }
+
+        /*Keep the latest pt of this policy for warm starting the next server count. If the iterations did not converge, that is the
+        estimate from the last simulation.*/
+        if (warm_start==1){
+            if (beliefs_converged==0){
+                estimate_pt();
+            }
+            for (i=0; i<=n_message_subsets; ++i){
+                for (j=1; j<=2; ++j){
+                    for (k=1; k<=T_max+1; ++k){
+                        pt_solved[policy_number][i][j][k]=pt[i][j][k];
+                    }
+                }
+            }
+            pt_solved_available[policy_number]=1;
+        }
+
+        /*A branched process only runs its own policy. The parent goes on with the next server count.*/
+        if (branch_child==1){
+            fclose(outfile);
+            exit(0);
+        }
+        if (branch_done==1){
+            branch_done = 0;
+            break;
+        }
     } /*Closing the loop for iter*/
     } /*Closing the loop for policy_number*/
+
+    if (staffing_mode==1){
+        report_staffing();
+    }
+
+    /*Free the last run's lists and events. When simlib is compiled with SIMLIB_PROFILE, this also prints that run's profile.*/
+    if (iteration_count>=1){
+        cleanup_simlib();
+    }
     fclose(infile);
     fclose(outfile);
+    if (bench_mode==1){
+        fclose(benchfile);
+    }
 
     return 0;
 }
 
 /*******************************************************************************************/
 
-void init_model(void)  /* Initialization function. */
+void estimate_pt(void)  /* Service probability estimation function. */
 {
-	/*Making all servers idle and resetting their statistics.*/
-	for (i=1; i<=n_servers; ++i){
-		server_status[i]=0;
-		server_intime[i]=0.0;
-		server_outtime[i]=0.0;
-		server_util[i]=0.0;
-		server_busy_time[i]=0.0;
-	}
-
-	/*Reset statistical counters*/
-	starttime=0;
-	wait_time[1]=0;
-	wait_time[2]=0;
-	calls_received[1]=0;
-	calls_received[2]=0;
-    calls_answered[1]=0;
-    calls_answered[2]=0;
-    calls_abandoned = 0;
-    callbacks_not_answered = 0;
-    callbacks_offered = 0;
-    callbacks_accepted = 0;
-
-   	num_custs_delayed = 0; /*Reset the number of customers delayed*/
-
-    /*Setting initial posterior probabilities*/
-   	for (i=1; i<=N_Callers; ++i){
-        for (j=1; j<=N_Latent_Classes; ++j){
-            Post_Prob[i][j]=p_s[j];
+    /*The service probability in a period is the fraction of the callers at risk in that period who were served in it.*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){ /*1 is online and 2 is offline*/
+            for (k=1; k<=T_max; ++k){
+                if (servicenum[i][j][k]>0){
+                    pt[i][j][k]=servicenum[i][j][k]/atrisk[i][j][k];
+                }else{
+                    pt[i][j][k]=0;
+                }
+                pt_support[i][j][k]=atrisk[i][j][k];
+            }
+            pt[i][j][T_max+1]=1;
         }
-   	}
+    }
+}
 
-	/*Scheduling arrival events*/
-	for (i=1; i<=N_Callers; ++i){
-        transfer[10]=i; /*Record caller number in transfer array for retrieval later*/
-        next_arrival_period = ceil(expon(Avg_Interstring_Time[Latent_Class[i]],STREAM)); /*When the caller will arrive*/
-        event_schedule(next_arrival_period,EVENT_ARRIVAL);
+/*******************************************************************************************/
 
-        /*Update Posterior probabilities*/
-        sum_post_prob = 0;
-        for (j=1; j<=N_Latent_Classes; ++j){
-            Post_Prob[i][j]=Post_Prob[i][j]*lambda_s[j]*exp(-lambda_s[j]*(next_arrival_period/24/60/60*period_length));
-            sum_post_prob = sum_post_prob + Post_Prob[i][j];
-        }
-        for (j=1; j<=N_Latent_Classes; ++j){
-            Post_Prob[i][j]=Post_Prob[i][j]/sum_post_prob;
-            if (Post_Prob[i][j]>1-.0000000001){
-                Post_Prob[i][j]=1;
+void compare_beliefs(void)  /* Belief comparison function. */
+{
+    /*Find the largest change in pt and cb_answer_prob, and in EW relative to its size (at least one period), since the previous
+    iteration, over the periods with at least belief_min_support callers at risk. Then keep the current beliefs for the next comparison.*/
+    belief_change=0;
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=1; k<=T_max; ++k){
+                if (pt_support[i][j][k]>=belief_min_support){
+                    temp=fabs(pt[i][j][k]-pt_prev[i][j][k]);
+                    if (temp>belief_change){
+                        belief_change=temp;
+                    }
+                    temp=fabs(EW[i][j][k]-EW_prev[i][j][k])/(fabs(EW_prev[i][j][k])>1 ? fabs(EW_prev[i][j][k]) : 1);
+                    if (temp>belief_change){
+                        belief_change=temp;
+                    }
+                }
+                pt_prev[i][j][k]=pt[i][j][k];
+                EW_prev[i][j][k]=EW[i][j][k];
             }
-            if (Post_Prob[i][j]<.0000000001){
-                Post_Prob[i][j]=0;
+        }
+        for (j=0; j<=1; ++j){
+            if (pt_support[i][2][1]>=belief_min_support){
+                temp=fabs(cb_answer_prob[i][j]-cb_answer_prob_prev[i][j]);
+                if (temp>belief_change){
+                    belief_change=temp;
+                }
             }
+            cb_answer_prob_prev[i][j]=cb_answer_prob[i][j];
         }
-	}
-
-	/*Scheduling the initial abandonment decision event.*/
-	event_schedule(sim_time+0.01,EVENT_ABANDON_DECISION);
+    }
 }
 
 /*******************************************************************************************/
 
-void arrive(void)  /* Arrival event function. */
+void compute_beliefs(void)  /* Belief function. */
 {
-    /*Update caller number and latent class*/
-    caller_number = transfer[10];
-    caller_class = Latent_Class[caller_number];
+    /*Callers' beliefs, the expected waiting times EW and the callback answering probabilities cb_answer_prob, follow from the service
+    probabilities pt. Start from zeros, since both are accumulated below.*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=1; k<=T_max; ++k){
+                EW[i][j][k]=0;
+            }
+        }
+        for (j=0; j<=1; ++j){
+            cb_answer_prob[i][j]=0;
+        }
+    }
 
-    /*Reset best server and temp_time*/
-    best_server=0;
-    temp_time=0;
+    /*BEGIN BLOCK*/
+    /*In this block we find the expected waiting times given the message, the period, and the channel.*/
 
-    /*Pick the server that has been idle for the longest time*/
-    for (num_server=n_servers; num_server>=1; --num_server){
-        if (((sim_time-server_busy_time[num_server])>=temp_time) && (server_status[num_server]==0)){
-            best_server=num_server;
-            temp_time=sim_time-server_busy_time[num_server];
+    /*FIRST, REQUIRED WAITING TIME CDF*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            req_wait_cdf[i][j][1] = pt[i][j][1];
         }
     }
 
-    if (best_server>0) { /*There is an idle server. So, the caller is immediately served*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=2; k<=T_max; ++k){
+                req_wait_cdf[i][j][k] = req_wait_cdf[i][j][k-1]+(1-req_wait_cdf[i][j][k-1])*pt[i][j][k];
+            }
+        }
+    }
 
-        /* Record the time of arrival to the server and make server busy*/
-        server_intime[best_server]=sim_time;
-        server_status[best_server]=1;
 
-        /*Update statistics*/
-        if (num_custs_delayed>=transient-1){
-            ++calls_received[1];
-            ++calls_answered[1];
+    /*SECOND, REQUIRED WAITING TIME PDF*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            req_wait_pdf[i][j][1] = req_wait_cdf[i][j][1];
         }
+    }
 
-        /*Increment num_custs_delayed and do record starttime if the transient threshold has been passed*/
-        ++num_custs_delayed;
-        if (num_custs_delayed==transient){
-            starttime=sim_time;
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=2; k<=T_max; ++k){
+                req_wait_pdf[i][j][k] = req_wait_cdf[i][j][k]-req_wait_cdf[i][j][k-1];
+            }
+        }
+    }
+
+    /*THIRD, EXPECTED WAITING TIME*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (l=1; l<=T_max; ++l){
+                EW[i][j][1] = EW[i][j][1] + l*req_wait_pdf[i][j][l];
+            }
+        }
+    }
+
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=2; k<=T_max; ++k){
+                for (l=k; l<=T_max; ++l){
+                    if(req_wait_cdf[i][j][l]<1){
+                        EW[i][j][k] = EW[i][j][k] + (l-k+1)*req_wait_pdf[i][j][l]/(1-req_wait_cdf[i][j][k-1]);
+                    }else{
+                        EW[i][j][k] = EW[i][j][k] + 0;
+                    }
+                }
+            }
+        }
+    }
+
+    /*BEGIN BLOCK*/
+    /*In this block we find the callback answering probabilities by message by day/evening given the availability probabilities and
+    waiting time distribution in the offline queue for each offline message*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=0; j<=1; ++j){ /*Day and Evening*/
+            for (k=1; k<=T_max; ++k){
+                offline_message_minute = ceil(k/periods_per_minute);
+                cb_answer_prob[i][j]=cb_answer_prob[i][j]+req_wait_pdf[i][2][k]*avail_prob[offline_message_minute][j];
+            }
+        }
+    }
+
+    /*In abandonment_mode 1, tabulate the online queue survival probabilities implied by EW*/
+    if (abandonment_mode==1){
+        build_abandon_table();
+    }
+}
+
+/*******************************************************************************************/
+
+void update_beliefs(void)  /* Belief update event function. */
+{
+    /*Estimate pt from the counts so far and update the beliefs that arriving and waiting callers use from now on*/
+    estimate_pt();
+    compute_beliefs();
+
+    /*Discount the counts, so that older observations, made under older beliefs, fade out*/
+    for (i=0; i<=n_message_subsets; ++i){
+        for (j=1; j<=2; ++j){
+            for (k=1; k<=T_max; ++k){
+                servicenum[i][j][k]=servicenum[i][j][k]*belief_decay;
+                atrisk[i][j][k]=atrisk[i][j][k]*belief_decay;
+            }
+        }
+    }
+
+    /*Report when the beliefs stop changing by more than belief_tolerance between updates. The first update is compared
+    with the initial beliefs, and a change of exactly 0 means that no period had enough support yet, so neither counts.*/
+    if (belief_tolerance>0){
+        compare_beliefs();
+        if (beliefs_converged==0 && sim_time>=2*belief_update_period && belief_change>0 && belief_change<=belief_tolerance){
+            printf("Beliefs stabilized at period %.0f after %d customers (largest change %g)\n",sim_time,num_custs_delayed,belief_change);
+            beliefs_converged = 1;
+        }
+    }
+
+    /*Schedule the next update*/
+    event_schedule(sim_time+belief_update_period,EVENT_BELIEF_UPDATE);
+}
+
+/*******************************************************************************************/
+
+void branch_policies(void)  /* Policy branching function. */
+{
+    int   branch_policy, c, status, rows_pipe[2], obs_pipe[2], cmd_pipe[2];
+    int   rows_fd[1+N_Policies], obs_fd[1+N_Policies], cmd_fd[1+N_Policies];
+    pid_t pid;
+    FILE  *rows;
+
+    branch_pending = 0;
+
+    /*Anything still buffered would otherwise be written once by every process*/
+    fflush(stdout);
+    fflush(outfile);
+
+    /*Fork one process per policy. Each one continues this run under its policy and sends its rows back through a pipe. In selection_mode 1,
+    two more pipes carry its batch outputs to this process and the selection's decisions back.*/
+    for (branch_policy=lowest_policy_number; branch_policy<=highest_policy_number; ++branch_policy){
+        if (pipe(rows_pipe)!=0 || pipe(obs_pipe)!=0 || pipe(cmd_pipe)!=0){
+            printf("Could not open the pipes for policy %d\n",branch_policy);
+            exit(1);
+        }
+        pid = fork();
+        if (pid<0){
+            printf("Could not start a process for policy %d\n",branch_policy);
+            exit(1);
+        }
+        if (pid==0){
+            close(rows_pipe[0]);
+            close(obs_pipe[0]);
+            close(cmd_pipe[1]);
+            for (c=lowest_policy_number; c<branch_policy; ++c){
+                close(rows_fd[c]);
+                close(obs_fd[c]);
+                close(cmd_fd[c]);
+            }
+            outfile = fdopen(rows_pipe[1],"w");
+            selection_obs_fd = obs_pipe[1];
+            selection_cmd_fd = cmd_pipe[0];
+            branch_child = 1;
+            policy_number = branch_policy;
+            selection_active = (selection_mode==1 && (iter==n_iter || online_beliefs==1));
+            printf("Policy %d branches off after %d customers\n",policy_number,num_custs_delayed);
+            return;
+        }
+        close(rows_pipe[1]);
+        close(obs_pipe[1]);
+        close(cmd_pipe[0]);
+        rows_fd[branch_policy] = rows_pipe[0];
+        obs_fd[branch_policy] = obs_pipe[0];
+        cmd_fd[branch_policy] = cmd_pipe[1];
+    }
+
+    /*Run the selection procedure on the batch outputs. Once it is over, closing the command pipes tells the policies still waiting for a
+    decision, or still to send a batch, to finish their runs on their own, so none of them is left blocked while their rows are read.*/
+    if (selection_mode==1){
+        select_policy(obs_fd, cmd_fd);
+    }
+    for (branch_policy=lowest_policy_number; branch_policy<=highest_policy_number; ++branch_policy){
+        close(cmd_fd[branch_policy]);
+    }
+
+    /*Copy the rows into the .csv file in policy order, and wait for the processes to finish*/
+    for (branch_policy=lowest_policy_number; branch_policy<=highest_policy_number; ++branch_policy){
+        rows = fdopen(rows_fd[branch_policy],"r");
+        while ((c=fgetc(rows))!=EOF){
+            fputc(c,outfile);
+        }
+        fclose(rows);
+        close(obs_fd[branch_policy]);
+    }
+    while (wait(&status)>0){
+        if (!WIFEXITED(status) || WEXITSTATUS(status)!=0){
+            printf("A policy process failed\n");
+            exit(1);
+        }
+    }
+    fflush(outfile);
+    branch_done = 1;
+}
+
+/*******************************************************************************************/
+
+void select_policy(int obs_fd[], int cmd_fd[])  /* Policy selection function. */
+{
+    /*KN fully sequential procedure (Kim and Nelson 2001) for the policy with the smallest mean batch output. After selection_n0 batches of
+    every policy, the variances of the differences between policies fix how far apart their means must be to drop the worse one, and
+    that distance shrinks as batches accumulate, until one policy is left or the runs end.*/
+    int    n_policies, n_alive, batches, b, p, q, ended, alive[1+N_Policies], dropped[1+N_Policies];
+    double value, h2, width, x0[1+N_Policies][1+selection_n0], sum[1+N_Policies], s2[1+N_Policies][1+N_Policies];
+    char   command;
+
+    n_policies = highest_policy_number-lowest_policy_number+1;
+    h2 = (selection_n0-1)*(pow(2*selection_alpha/(n_policies>1 ? n_policies-1 : 1),-2.0/(selection_n0-1))-1);
+    for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+        alive[p] = 1;
+        sum[p] = 0;
+    }
+    n_alive = n_policies;
+    batches = 0;
+    ended = 0;
+
+    while (n_alive>1){
+
+        /*Collect the next batch output of every remaining policy. A closed pipe means that the runs ended.*/
+        for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+            if (alive[p]==1){
+                if (read(obs_fd[p],&value,sizeof(double))!=(ssize_t) sizeof(double)){
+                    ended = 1;
+                    break;
+                }
+                sum[p] = sum[p]+value;
+                if (batches<selection_n0){
+                    x0[p][batches+1] = value;
+                }
+            }
+        }
+        if (ended==1){
+            break;
+        }
+        ++batches;
+
+        /*After the first stage, the sample variances of the differences between policies*/
+        if (batches==selection_n0){
+            for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+                for (q=lowest_policy_number; q<=highest_policy_number; ++q){
+                    value = 0;
+                    for (b=1; b<=selection_n0; ++b){
+                        value = value+x0[p][b]-x0[q][b];
+                    }
+                    value = value/selection_n0;
+                    s2[p][q] = 0;
+                    for (b=1; b<=selection_n0; ++b){
+                        s2[p][q] = s2[p][q]+(x0[p][b]-x0[q][b]-value)*(x0[p][b]-x0[q][b]-value);
+                    }
+                    s2[p][q] = s2[p][q]/(selection_n0-1);
+                }
+            }
+        }
+
+        /*Drop every policy whose mean is worse than another remaining policy's by more than the current width*/
+        for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+            dropped[p] = 0;
+            if (alive[p]==1 && batches>=selection_n0){
+                for (q=lowest_policy_number; q<=highest_policy_number; ++q){
+                    if (q!=p && alive[q]==1){
+                        width = selection_delta/(2*batches)*(h2*s2[p][q]/(selection_delta*selection_delta)-batches);
+                        if (width<0){
+                            width = 0;
+                        }
+                        if (sum[p]/batches>sum[q]/batches+width){
+                            dropped[p] = 1;
+                        }
+                    }
+                }
+            }
+        }
+        for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+            if (dropped[p]==1){
+                alive[p] = 0;
+                --n_alive;
+            }
+        }
+
+        /*Tell the policies whether they continue, are dropped, or won and finish their run on their own*/
+        for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+            if (alive[p]==1 || dropped[p]==1){
+                command = (dropped[p]==1) ? 'e' : (n_alive==1 ? 'f' : 'c');
+                if (write(cmd_fd[p],&command,1)!=1){
+                    printf("Could not reach the process of policy %d\n",p);
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    /*Report the best policy. If the runs ended first, that is the best mean among the remaining policies, without the confidence level.*/
+    q = 0;
+    for (p=lowest_policy_number; p<=highest_policy_number; ++p){
+        if (alive[p]==1 && (q==0 || (batches>0 && sum[p]<sum[q]))){
+            q = p;
+        }
+    }
+    if (n_alive==1){
+        printf("Servers = %d: policy %d selected after %d batches (confidence %g, indifference zone %g)\n",n_servers,q,batches,1-selection_alpha,selection_delta);
+    }else{
+        printf("Servers = %d: policy %d has the best mean after %d batches, but %d policies are still within the indifference zone\n",n_servers,q,batches,n_alive);
+    }
+}
+
+/*******************************************************************************************/
+
+void selection_batch_done(void)  /* Selection batch function. */
+{
+    /*Send the output of the batch that just ended to the selection procedure, and wait for its decision. A closed command pipe means that
+    the selection is over (another policy's run ended first), so the run finishes on its own as with 'f'.*/
+    double value;
+    char   command;
+    ssize_t got;
+
+    if (num_custs_delayed>warmup_customers){
+        if (selection_output==1){
+            value=(sum_wait_time-selection_wait_time)/(sum_calls_received-selection_calls_received)*period_length;
+        }else{
+            value=(sum_calls_abandoned-selection_calls_abandoned)/(sum_calls_received_online-selection_calls_received_online);
+        }
+        if (write(selection_obs_fd,&value,sizeof(double))!=(ssize_t) sizeof(double)){
+            printf("Policy %d lost the selection procedure\n",policy_number);
+            exit(1);
+        }
+        got = read(selection_cmd_fd,&command,1);
+        if (got<0){
+            printf("Policy %d lost the selection procedure\n",policy_number);
+            exit(1);
+        }
+        if (got==0){
+            command = 'f';
+        }
+        if (command=='e'){
+            printf("Policy %d dropped by the selection after %d customers\n",policy_number,num_custs_delayed);
+            customers_required=num_custs_delayed;
+            selection_active=0;
+        }else if (command=='f'){
+            selection_active=0;
+        }
+    }
+    selection_wait_time=sum_wait_time;
+    selection_calls_received=sum_calls_received;
+    selection_calls_received_online=sum_calls_received_online;
+    selection_calls_abandoned=sum_calls_abandoned;
+}
+
+/*******************************************************************************************/
+
+void register_state(void)  /* Checkpoint state function. */
+{
+    /*Everything that carries over from one event to the next. The beliefs (pt, EW, cb_answer_prob) are left out, so that a restored run
+    continues under the beliefs of its own iteration.*/
+    checkpoint_region(server_status, sizeof(server_status));
+    checkpoint_region(server_intime, sizeof(server_intime));
+    checkpoint_region(server_outtime, sizeof(server_outtime));
+    checkpoint_region(server_util, sizeof(server_util));
+    checkpoint_region(server_busy_time, sizeof(server_busy_time));
+    checkpoint_region(servicenum, sizeof(servicenum));
+    checkpoint_region(atrisk, sizeof(atrisk));
+    checkpoint_region(Post_Prob, sizeof(Post_Prob));
+    checkpoint_region(renege_ticket, sizeof(renege_ticket));
+    checkpoint_region(&starttime, sizeof(starttime));
+    checkpoint_region(wait_time, sizeof(wait_time));
+    checkpoint_region(calls_received, sizeof(calls_received));
+    checkpoint_region(calls_answered, sizeof(calls_answered));
+    checkpoint_region(&calls_abandoned, sizeof(calls_abandoned));
+    checkpoint_region(&callbacks_not_answered, sizeof(callbacks_not_answered));
+    checkpoint_region(&callbacks_offered, sizeof(callbacks_offered));
+    checkpoint_region(&callbacks_accepted, sizeof(callbacks_accepted));
+    checkpoint_region(&callbacks_pending, sizeof(callbacks_pending));
+    checkpoint_region(&last_online_wait_time, sizeof(last_online_wait_time));
+    checkpoint_region(&num_custs_delayed, sizeof(num_custs_delayed));
+    checkpoint_region(&customers_required, sizeof(customers_required));
+    checkpoint_region(&warmup_customers, sizeof(warmup_customers));
+    checkpoint_region(&sum_wait_time, sizeof(sum_wait_time));
+    checkpoint_region(&sum_calls_received, sizeof(sum_calls_received));
+    checkpoint_region(&sum_calls_received_online, sizeof(sum_calls_received_online));
+    checkpoint_region(&sum_calls_abandoned, sizeof(sum_calls_abandoned));
+    checkpoint_region(&sum_busy_time, sizeof(sum_busy_time));
+    checkpoint_region(&batch_wait_time, sizeof(batch_wait_time));
+    checkpoint_region(&batch_calls_received, sizeof(batch_calls_received));
+    checkpoint_region(&batch_calls_received_online, sizeof(batch_calls_received_online));
+    checkpoint_region(&batch_calls_abandoned, sizeof(batch_calls_abandoned));
+    checkpoint_region(&batch_busy_time, sizeof(batch_busy_time));
+    checkpoint_region(&batch_start, sizeof(batch_start));
+    checkpoint_region(&service_total, sizeof(service_total));
+    checkpoint_region(&services_started, sizeof(services_started));
+    checkpoint_region(&batch_service_total, sizeof(batch_service_total));
+    checkpoint_region(&batch_services, sizeof(batch_services));
+    if (crn_mode==2){
+        checkpoint_region(caller_seed, (1+N_Callers)*sizeof(*caller_seed));
+        checkpoint_region(caller_draws, (1+N_Callers)*sizeof(*caller_draws));
+    }
+}
+
+/*******************************************************************************************/
+
+void init_model(void)  /* Initialization function. */
+{
+	/*Making all servers idle and resetting their statistics.*/
+	for (i=1; i<=n_servers; ++i){
+		server_status[i]=0;
+		server_intime[i]=0.0;
+		server_outtime[i]=0.0;
+		server_util[i]=0.0;
+		server_busy_time[i]=0.0;
+	}
+
+	/*Reset statistical counters*/
+	starttime=0;
+	wait_time[1]=0;
+	wait_time[2]=0;
+	calls_received[1]=0;
+	calls_received[2]=0;
+    calls_answered[1]=0;
+    calls_answered[2]=0;
+    calls_abandoned = 0;
+    callbacks_not_answered = 0;
+    callbacks_offered = 0;
+    callbacks_accepted = 0;
+    callbacks_pending = 0;
+    service_total = 0;
+    services_started = 0;
+    sum_wait_time = 0;
+    sum_calls_received = 0;
+    sum_calls_received_online = 0;
+    sum_calls_abandoned = 0;
+    sum_busy_time = 0;
+
+   	num_custs_delayed = 0; /*Reset the number of customers delayed*/
+
+    /*Set the run length. In stopping_mode 1 it is lowered once the target precision is reached.*/
+    if (stopping_mode==1){
+        customers_required = max_customers_required;
+    }else{
+        customers_required = Number_of_customers_required;
+    }
+
+    /*Set the warm-up length. With MSER-5 it is lowered once the detector finds the end of the warm-up.*/
+    if (warmup_mode==1){
+        warmup_customers = Number_of_customers_required/2;
+    }else{
+        warmup_customers = transient;
+    }
+
+    /*Setting initial posterior probabilities*/
+   	for (i=1; i<=N_Callers; ++i){
+        for (j=1; j<=N_Latent_Classes; ++j){
+            Post_Prob[i][j]=p_s[j];
+        }
+   	}
+
+	/*Scheduling arrival events*/
+	for (i=1; i<=N_Callers; ++i){
+        transfer[10]=i; /*Record caller number in transfer array for retrieval later*/
+        next_arrival_period = ceil(expon(Avg_Interstring_Time[Latent_Class[i]],stream_for(STREAM_ARRIVAL,i))); /*When the caller will arrive*/
+        event_schedule(next_arrival_period,EVENT_ARRIVAL);
+
+        /*Update Posterior probabilities*/
+        sum_post_prob = 0;
+        for (j=1; j<=N_Latent_Classes; ++j){
+            Post_Prob[i][j]=Post_Prob[i][j]*lambda_s[j]*exp(-lambda_s[j]*(next_arrival_period/24/60/60*period_length));
+            sum_post_prob = sum_post_prob + Post_Prob[i][j];
+        }
+        for (j=1; j<=N_Latent_Classes; ++j){
+            Post_Prob[i][j]=Post_Prob[i][j]/sum_post_prob;
+            if (Post_Prob[i][j]>1-.0000000001){
+                Post_Prob[i][j]=1;
+            }
+            if (Post_Prob[i][j]<.0000000001){
+                Post_Prob[i][j]=0;
+            }
+        }
+	}
+
+	/*Scheduling the initial abandonment decision event. In abandonment_mode 1, renege events are scheduled as callers join the online queue instead.*/
+	if (abandonment_mode==0){
+		event_schedule(sim_time+0.01,EVENT_ABANDON_DECISION);
+	}
+
+	/*Scheduling the first belief update.*/
+	if (online_beliefs==1){
+		beliefs_converged = 0;
+		event_schedule(sim_time+belief_update_period,EVENT_BELIEF_UPDATE);
+	}
+}
+
+/*******************************************************************************************/
+
+void arrive(void)  /* Arrival event function. */
+{
+    /*Update caller number and latent class*/
+    caller_number = transfer[10];
+    caller_class = Latent_Class[caller_number];
+
+    /*Pick the server that has been idle for the longest time*/
+    best_server=find_idle_server();
+
+    if (best_server>0) { /*There is an idle server. So, the caller is immediately served*/
+
+        /* Record the time of arrival to the server and make server busy*/
+        server_intime[best_server]=sim_time;
+        server_status[best_server]=1;
+
+        /*Update statistics*/
+        if (num_custs_delayed>=warmup_customers-1){
+            ++calls_received[1];
+            ++calls_answered[1];
+            ++sum_calls_received;
+            ++sum_calls_received_online;
+            sampst(0.0, VAR_ANSWER_ONLINE);
+        }
+
+        /*Count the customer, passing their waiting time to the warm-up detector*/
+        customer_done(0);
+        if (call_log_mode==1){
+            log_call(0, CALL_ANSWERED, best_server, 0);
         }
 
         /*Update last_online_wait_time for the next time we generate an expected wait in the online queue.*/
@@ -608,8 +1628,10 @@ void arrive(void)  /* Arrival event function. */
         /* Schedule a departure (service completion) for this server, and save the server number in attribute 3
          of the event list. */
         transfer[3]=best_server;
-        temp=floor(sim_time)+empric_cdf(lcgrand(STREAM),1); /*Randomly draw service time from empirical distribution of service times*/
+        temp=floor(sim_time)+empric_cdf(lcgrand(stream_for(STREAM_SERVICE,caller_number)),1); /*Randomly draw service time from empirical distribution of service times*/
         event_schedule(temp, EVENT_DEPARTURE);
+        service_total=service_total+temp-floor(sim_time);
+        ++services_started;
 
    }else{ /*There are no idle servers*/
 
@@ -620,7 +1642,7 @@ void arrive(void)  /* Arrival event function. */
 
             /*For policy SQ, it is a queue-length based estimator*/
             queue_length_online = list_size[LIST_ONLINE_QUEUE];
-            queue_length_offline = list_size[LIST_OFFLINE_QUEUE];
+            queue_length_offline = list_size[LIST_OFFLINE_QUEUE] + callbacks_pending;
             online_wait_prediction = avg_service_time*(queue_length_online + queue_length_offline)/n_servers;
 
         }else{ /*Rest of the policies*/
@@ -635,6 +1657,9 @@ void arrive(void)  /* Arrival event function. */
         the types are the following: 0 = No callback offered, 1 = Alarm (Scheduled), 2 = Hold Spot, 3 = Window*,
         and if necessary the LB and UB for the window policy*/
         floor_online_wait_prediction = floor(online_wait_prediction);
+        if (floor_online_wait_prediction>Max_Wait_Minutes){ /*Longer predictions get the messages of the longest one*/
+            floor_online_wait_prediction = Max_Wait_Minutes;
+        }
 
         online_message = Online_Message_Index[floor_online_wait_prediction][policy_number];
         offline_message = Offline_Message_Index[floor_online_wait_prediction][policy_number];
@@ -652,7 +1677,7 @@ void arrive(void)  /* Arrival event function. */
         v2 = offline_pref[caller_class][Evening] - c_f[caller_class][Evening]*EW[offline_message][2][1] + r[caller_class][Evening]*cb_answer_prob[offline_message][Evening]; /*Nominal utility of accepting callback offer*/
 
         if (callback_type==0){ /*No callback offered*/
-            temp = lcgrand(STREAM);
+            temp = lcgrand(stream_for(STREAM_CHOICE,caller_number));
             if(temp<exp(v0)/(exp(v0)+exp(v1))){
                 decision = 0; /*Caller immediately abandons*/
             }else{
@@ -662,15 +1687,15 @@ void arrive(void)  /* Arrival event function. */
         }else{ /*Callback is offered*/
 
             /*Update statistics*/
-            if (num_custs_delayed>=transient-1){
+            if (num_custs_delayed>=warmup_customers-1){
                 ++callbacks_offered;
             }
 
-            temp = lcgrand(STREAM);
+            temp = lcgrand(stream_for(STREAM_CHOICE,caller_number));
             if(temp<exp(v2)/(exp(v0)+exp(v1)+exp(v2))){ /*Caller accepts callback offer*/
                 decision = 2;
             }else{
-                temp = lcgrand(STREAM);
+                temp = lcgrand(stream_for(STREAM_CHOICE,caller_number));
                 if(temp<exp(v0)/(exp(v0)+exp(v1))){
                     decision = 0; /*Caller immediately abandons*/
                 }else{
@@ -684,19 +1709,22 @@ void arrive(void)  /* Arrival event function. */
         if (decision==0){
 
             /*Update Statistics*/
-            if (num_custs_delayed>=transient-1){
+            if (num_custs_delayed>=warmup_customers-1){
                 ++calls_received[1];
                 ++calls_abandoned;
+                ++sum_calls_received;
+                ++sum_calls_received_online;
+                ++sum_calls_abandoned;
             }
 
-			/*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-			++num_custs_delayed;
-            if (num_custs_delayed==transient){
-                starttime=sim_time;
+            /*Count the customer, passing their waiting time to the warm-up detector*/
+            customer_done(0);
+            if (call_log_mode==1){
+                log_call(0, CALL_ABANDONED, 0, 0);
             }
 
             /*Schedule next arrival for caller*/
-            next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],STREAM)); /*Generate from caller's arrival rate*/
+            next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],stream_for(STREAM_ARRIVAL,caller_number))); /*Generate from caller's arrival rate*/
             event_schedule(sim_time+next_arrival_period,EVENT_ARRIVAL);
         }
 
@@ -716,22 +1744,37 @@ void arrive(void)  /* Arrival event function. */
         if (decision==1){
             /*Place the caller at the end of the online queue*/
             list_file(LAST, LIST_ONLINE_QUEUE);
+
+            /*In abandonment_mode 1, draw when the caller will abandon*/
+            if (abandonment_mode==1){
+                schedule_renege();
+            }
         }
 
         /*CASE 3: CALLER ACCEPTS CALLBACK OFFER*/
         if (decision==2){
 
             /*Update statistics*/
-            if (num_custs_delayed>=transient-1){
+            if (num_custs_delayed>=warmup_customers-1){
                 ++callbacks_accepted;
             }
 
-            if (callback_type==1){ /*Scheduled Callback*/
-                /*Place the caller in the offline queue sorted in increasing order of their expected time to receive their callback.*/
-                list_file(INCREASING, LIST_OFFLINE_QUEUE);
+            if (callback_mode==1 && callback_type!=2){ /*Scheduled or window callback held in the event list until it is due*/
+
+                if (callback_type==1){
+                    callback_due_time = transfer[9];
+                }else{
+                    callback_due_time = sim_time + low_bound * periods_per_minute;
+                }
+
+                /*transfer[1] becomes the event time, so keep the arrival time in transfer[3] until the callback is due*/
+                transfer[3] = transfer[1];
+                ++callbacks_pending;
+                timest(callbacks_pending, VAR_CALLBACKS_PENDING);
+                event_schedule(callback_due_time, EVENT_CALLBACK_DUE);
+
             }else{
-                /*Place the caller at the end of the offline queue*/
-                list_file(LAST, LIST_OFFLINE_QUEUE);
+                file_callback();
             }
         }
    }
@@ -746,12 +1789,23 @@ void depart(int depart_server)  /* Departure event function. */
     caller_class = Latent_Class[caller_number];
 
     /*Schedule next arrival for caller*/
-    next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],STREAM)); /*Generate from caller's arrival rate*/
+    next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],stream_for(STREAM_ARRIVAL,caller_number))); /*Generate from caller's arrival rate*/
     event_schedule(sim_time+next_arrival_period,EVENT_ARRIVAL);
 
     /*Update server statistics*/
     server_outtime[depart_server]=sim_time;
     server_busy_time[depart_server]=server_busy_time[depart_server]+server_outtime[depart_server]-server_intime[depart_server];
+    sum_busy_time=sum_busy_time+server_outtime[depart_server]-server_intime[depart_server];
+
+    /*Find the next caller for the server*/
+    serve_next(depart_server);
+}
+
+/*******************************************************************************************/
+
+void serve_next(int free_server)  /* Server assignment function. */
+{
+    /*The server free_server has just become free. Decide which queue it serves next and start that service, or make the server idle.*/
 
     /*BEGIN BLOCK*/
     /* In this block, we determine based on the policy which queue to serve. If the outcome is zero, we don't serve any queue. If it is 1, then we serve
@@ -798,9 +1852,12 @@ void depart(int depart_server)  /* Departure event function. */
                 if(sim_time>=scheduled_alarm_time){ /*Callback is initiated*/
 
                     /*Generate random number for determining whether callback is answered*/
-                    temp = lcgrand(STREAM);
+                    temp = lcgrand(stream_for(STREAM_CALLBACK,caller_number));
 
                     offline_message_minute = ceil((sim_time-offline_call_arrival_period)/periods_per_minute);
+                    if (offline_message_minute>Max_Wait_Minutes){ /*Availability beyond the last tabulated minute is that of the last minute*/
+                        offline_message_minute = Max_Wait_Minutes;
+                    }
 
                     if(temp<avail_prob[offline_message_minute][Evening]){ /*Caller is available to take callback*/
 
@@ -816,16 +1873,18 @@ void depart(int depart_server)  /* Departure event function. */
                     }else{ /*Caller is not available to take callback*/
 
                         /*Update statistics*/
-                        if (num_custs_delayed>=transient-1){
+                        if (num_custs_delayed>=warmup_customers-1){
                             wait_time[2]=wait_time[2]+sim_time - transfer[1];
+                            sum_wait_time=sum_wait_time+sim_time - transfer[1];
                             ++calls_received[2];
+                            ++sum_calls_received;
                             ++callbacks_not_answered;
                         }
 
-                        /*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-                        ++num_custs_delayed;
-                        if (num_custs_delayed==transient){
-                            starttime=sim_time;
+                        /*Count the customer, passing their waiting time to the warm-up detector*/
+                        customer_done(sim_time - transfer[1]);
+                        if (call_log_mode==1){
+                            log_call(2, CALL_CALLBACK_MISSED, 0, sim_time - transfer[1]);
                         }
                     }
 
@@ -879,9 +1938,12 @@ void depart(int depart_server)  /* Departure event function. */
                 list_remove(FIRST, LIST_OFFLINE_QUEUE);
 
                 /*Generate random number for determining whether callback is answered*/
-                temp = lcgrand(STREAM);
+                temp = lcgrand(stream_for(STREAM_CALLBACK,caller_number));
 
                 offline_message_minute = ceil((sim_time-offline_call_arrival_period)/periods_per_minute);
+                if (offline_message_minute>Max_Wait_Minutes){ /*Availability beyond the last tabulated minute is that of the last minute*/
+                    offline_message_minute = Max_Wait_Minutes;
+                }
 
                 if(temp<avail_prob[offline_message_minute][Evening]){ /*Caller is available to take callback*/
 
@@ -897,16 +1959,18 @@ void depart(int depart_server)  /* Departure event function. */
                 }else{ /*Caller is not available to take callback*/
 
                     /*Update statistics*/
-                    if (num_custs_delayed>=transient-1){
+                    if (num_custs_delayed>=warmup_customers-1){
                         wait_time[2]=wait_time[2]+sim_time - transfer[1];
+                        sum_wait_time=sum_wait_time+sim_time - transfer[1];
                         ++calls_received[2];
+                        ++sum_calls_received;
                         ++callbacks_not_answered;
                     }
 
-                    /*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-                    ++num_custs_delayed;
-                    if (num_custs_delayed==transient){
-                        starttime=sim_time;
+                    /*Count the customer, passing their waiting time to the warm-up detector*/
+                    customer_done(sim_time - transfer[1]);
+                    if (call_log_mode==1){
+                        log_call(2, CALL_CALLBACK_MISSED, 0, sim_time - transfer[1]);
                     }
                 }
             }
@@ -939,9 +2003,12 @@ void depart(int depart_server)  /* Departure event function. */
                 if(sim_time>=offline_call_arrival_period + low_bound * periods_per_minute){ /*Callback is initiated*/
 
                     /*Generate random number for determining whether callback is answered*/
-                    temp = lcgrand(STREAM);
+                    temp = lcgrand(stream_for(STREAM_CALLBACK,caller_number));
 
                     offline_message_minute = ceil((sim_time-offline_call_arrival_period)/periods_per_minute);
+                    if (offline_message_minute>Max_Wait_Minutes){ /*Availability beyond the last tabulated minute is that of the last minute*/
+                        offline_message_minute = Max_Wait_Minutes;
+                    }
 
                     if(temp<avail_prob[offline_message_minute][Evening]){ /*Caller is available to take callback*/
 
@@ -957,16 +2024,18 @@ void depart(int depart_server)  /* Departure event function. */
                     }else{ /*Caller is not available to take callback*/
 
                         /*Update statistics*/
-                        if (num_custs_delayed>=transient-1){
+                        if (num_custs_delayed>=warmup_customers-1){
                             wait_time[2]=wait_time[2]+sim_time - transfer[1];
+                            sum_wait_time=sum_wait_time+sim_time - transfer[1];
                             ++calls_received[2];
+                            ++sum_calls_received;
                             ++callbacks_not_answered;
                         }
 
-                        /*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-                        ++num_custs_delayed;
-                        if (num_custs_delayed==transient){
-                            starttime=sim_time;
+                        /*Count the customer, passing their waiting time to the warm-up detector*/
+                        customer_done(sim_time - transfer[1]);
+                        if (call_log_mode==1){
+                            log_call(2, CALL_CALLBACK_MISSED, 0, sim_time - transfer[1]);
                         }
                     }
 
@@ -988,7 +2057,7 @@ void depart(int depart_server)  /* Departure event function. */
 
     if (queue_to_serve == 0){
         /* We aren't serving anyone. So, make server idle.*/
-        server_status[depart_server]=0;
+        server_status[free_server]=0;
 
     }else{ /*We have a caller to serve*/
 
@@ -996,16 +2065,24 @@ void depart(int depart_server)  /* Departure event function. */
         list_remove(FIRST,queue_to_serve);
 
         /*Update statistics*/
-        if (num_custs_delayed>=transient-1){
+        if (num_custs_delayed>=warmup_customers-1){
             wait_time[queue_to_serve]=wait_time[queue_to_serve]+sim_time - transfer[1];
+            sum_wait_time=sum_wait_time+sim_time - transfer[1];
             ++calls_received[queue_to_serve];
+            ++sum_calls_received;
+            sum_calls_received_online=sum_calls_received_online+(queue_to_serve==1);
             ++calls_answered[queue_to_serve];
+            if (queue_to_serve==1){
+                sampst((sim_time - transfer[1]) * period_length, VAR_ANSWER_ONLINE);
+            }else{
+                sampst((sim_time - transfer[1]) * period_length, VAR_ANSWER_OFFLINE);
+            }
         }
 
-        /*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-        ++num_custs_delayed;
-        if (num_custs_delayed==transient){
-            starttime=sim_time;
+        /*Count the customer, passing their waiting time to the warm-up detector*/
+        customer_done(sim_time - transfer[1]);
+        if (call_log_mode==1){
+            log_call(queue_to_serve, CALL_ANSWERED, free_server, sim_time - transfer[1]);
         }
 
         /*Update last_online_wait_time for the next time we generate an expected wait in the online queue.*/
@@ -1018,6 +2095,9 @@ void depart(int depart_server)  /* Departure event function. */
 
         /*How long did caller wait*/
         delay=floor(sim_time-transfer[1]);
+        if (delay>T_max){ /*Waits beyond the service probability tables count in the last period*/
+            delay=T_max;
+        }
 
         /*Determine the message*/
         if (queue_to_serve ==1){
@@ -1028,7 +2108,7 @@ void depart(int depart_server)  /* Departure event function. */
 
         /*atrisk[1+n_message_subsets][1+2][1+T_max], servicenum[1+n_message_subsets][1+2][1+T_max];*/
 
-        if (delay>0 && num_custs_delayed>=transient){
+        if (delay>0 && num_custs_delayed>=warmup_customers){
             servicenum[message][queue_to_serve][delay]=servicenum[message][queue_to_serve][delay]+1;
             for (i=1; i<=delay; ++i){
                 atrisk[message][queue_to_serve][i]=atrisk[message][queue_to_serve][i]+1;
@@ -1038,10 +2118,64 @@ void depart(int depart_server)  /* Departure event function. */
 
         /* Schedule a departure (service completion) for this server, and save the server number in attribute 3
         of the event list. */
-        transfer[3]=depart_server;
-        temp=floor(sim_time)+empric_cdf(lcgrand(STREAM),1); /*Randomly draw service time from empirical distribution of service times*/
+        transfer[3]=free_server;
+        temp=floor(sim_time)+empric_cdf(lcgrand(stream_for(STREAM_SERVICE,(int) transfer[10])),1); /*Randomly draw service time from empirical distribution of service times*/
         event_schedule(temp, EVENT_DEPARTURE);
-        server_intime[depart_server]=sim_time;
+        service_total=service_total+temp-floor(sim_time);
+        ++services_started;
+        server_intime[free_server]=sim_time;
+    }
+}
+
+/*******************************************************************************************/
+
+int find_idle_server(void)  /* Idle server function. */
+{
+    /*Returns the server that has been idle for the longest time, or 0 if all servers are busy.*/
+
+    /*Reset best server and temp_time*/
+    best_server=0;
+    temp_time=0;
+
+    for (num_server=n_servers; num_server>=1; --num_server){
+        if (((sim_time-server_busy_time[num_server])>=temp_time) && (server_status[num_server]==0)){
+            best_server=num_server;
+            temp_time=sim_time-server_busy_time[num_server];
+        }
+    }
+    return best_server;
+}
+
+/*******************************************************************************************/
+
+void file_callback(void)  /* Offline queue filing function. */
+{
+    /*The caller whose record is in the transfer array accepted a callback.*/
+    if (transfer[6]==1){ /*Scheduled Callback*/
+        /*Place the caller in the offline queue sorted in increasing order of their expected time to receive their callback.*/
+        list_file(INCREASING, LIST_OFFLINE_QUEUE);
+    }else{
+        /*Place the caller at the end of the offline queue*/
+        list_file(LAST, LIST_OFFLINE_QUEUE);
+    }
+}
+
+/*******************************************************************************************/
+
+void callback_due(void)  /* Callback due event function. */
+{
+    /*A scheduled or window callback has reached its promised time. Restore its arrival time and place it in the offline queue, which in
+    callback_mode 1 only holds callbacks that are due.*/
+    transfer[1] = transfer[3];
+    --callbacks_pending;
+    timest(callbacks_pending, VAR_CALLBACKS_PENDING);
+    file_callback();
+
+    /*If a server is idle, it starts the callback right away*/
+    best_server=find_idle_server();
+    if (best_server>0){
+        server_status[best_server]=1;
+        serve_next(best_server);
     }
 }
 
@@ -1070,6 +2204,9 @@ void abandon_decision(void)  /* Abandonment Decision function. */
 
 		/*Getting the delay which is the difference between the sim_time and time of arrival*/
 		current_period=floor(sim_time-transfer[1])+1;
+		if (current_period>T_max){ /*Beyond the tables, callers use the expected wait of the last period*/
+		    current_period=T_max;
+		}
 
         /*Determine the nominal utilities of actions.*/
 		v0 = 0; /*Nominal utility of abandoning*/
@@ -1079,44 +2216,416 @@ void abandon_decision(void)  /* Abandonment Decision function. */
         abandon_prob = exp(v0)/(exp(v0)+exp(v1));
 
         /*Generate random number for determining whether caller abandons*/
-        temp = lcgrand(STREAM);
+        temp = lcgrand(stream_for(STREAM_ABANDON,caller_number));
 
     	if (temp <= abandon_prob){ /*Caller Abandons*/
+            abandon();
+		}else{ /*Caller chooses to wait in online queue. Place back in queue.*/
+			list_file(LAST,LIST_ONLINE_QUEUE);
+		}
+	  } /*Done looping through callers*/
+	}
+	/*Schedule the next abandonment decision event one period from now*/
+	event_schedule(sim_time+1,EVENT_ABANDON_DECISION);
+}
 
-            /*Update Statistics*/
-            if (num_custs_delayed>=transient-1){
-                wait_time[1]=wait_time[1]+sim_time - transfer[1];
-                ++calls_received[1];
-                ++calls_abandoned;
+/*******************************************************************************************/
+
+void abandon(void)  /* Abandonment function. */
+{
+    /*The caller whose record was just removed from the online queue into the transfer array abandons.*/
+
+    /*Update caller number, latent class and delay message subset*/
+    caller_number = transfer[10];
+    caller_class = Latent_Class[caller_number];
+    online_message = transfer[4];
+
+    /*Update Statistics*/
+    if (num_custs_delayed>=warmup_customers-1){
+        wait_time[1]=wait_time[1]+sim_time - transfer[1];
+        sum_wait_time=sum_wait_time+sim_time - transfer[1];
+        ++calls_received[1];
+        ++calls_abandoned;
+        ++sum_calls_received;
+        ++sum_calls_received_online;
+        ++sum_calls_abandoned;
+    }
+
+    /*Count the customer, passing their waiting time to the warm-up detector*/
+    customer_done(sim_time - transfer[1]);
+    if (call_log_mode==1){
+        log_call(1, CALL_ABANDONED, 0, sim_time - transfer[1]);
+    }
+
+    /*BEGIN BLOCK*/
+    /*In this block, we add the waiting time of this answered call to a table for figuring out pt (the service probabilities at the beginning of the next iteration.*/
+    delay=floor(sim_time-transfer[1]);
+    if (delay>T_max){ /*Waits beyond the service probability tables count in the last period*/
+        delay=T_max;
+    }
+    if (delay>0 && num_custs_delayed>=warmup_customers){
+        for (i=1; i<=delay; ++i){
+            atrisk[online_message][1][i]=atrisk[online_message][1][i]+1;
+        }
+    }
+    /*END BLOCK*/
+
+    /*Schedule next arrival for caller*/
+    next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],stream_for(STREAM_ARRIVAL,caller_number))); /*Generate from caller's arrival rate*/
+    event_schedule(sim_time+next_arrival_period,EVENT_ARRIVAL);
+}
+
+/*******************************************************************************************/
+
+void build_abandon_table(void)  /* Online queue survival table function. */
+{
+    /*In period k of waiting, a caller with message m abandons with the same probability used in abandon_decision(),
+    1/(1+exp(v1)) with v1 = r - c_n*EW[m][1][k]. Here we accumulate the probability of still waiting after each period.*/
+    int s, m, k;
+    double hazard, survival;
+
+    for (s=1; s<=N_Latent_Classes; ++s){
+        for (m=0; m<=n_message_subsets; ++m){
+            survival = 1;
+            hazard = 0;
+            for (k=1; k<=T_max; ++k){
+                hazard = 1/(1+exp(r[s][Evening] - c_n[s][Evening]*EW[m][1][k]));
+                survival = survival*(1-hazard);
+                abandon_survival[s][m][k] = survival;
             }
+            /*Past T_max periods, callers keep abandoning at the rate of the last tabulated period.*/
+            abandon_hazard_tail[s][m] = hazard;
+        }
+    }
+}
+
+/*******************************************************************************************/
+
+void schedule_renege(void)  /* Renege scheduling function. */
+{
+    /*The caller whose record is in the transfer array just joined the online queue. We draw the period in which they abandon by
+    inverting the survival table, and schedule a renege event 0.01 into that period, when abandon_decision() would have run.*/
+    int low, high, mid;
+    double u, survival, hazard, tail;
+
+    /*Take a new ticket for this visit first, so a renege event left over from an earlier visit is ignored even if no new one is scheduled*/
+    ++renege_ticket[caller_number];
+
+    u = lcgrand(stream_for(STREAM_ABANDON,caller_number));
 
-			/*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
-			++num_custs_delayed;
-            if (num_custs_delayed==transient){
-                starttime=sim_time;
+    if (abandon_survival[caller_class][online_message][T_max] <= u){
+
+        /*Binary search for the first period whose survival probability is at most u*/
+        low = 1;
+        high = T_max;
+        while (low < high){
+            mid = (low + high)/2;
+            if (abandon_survival[caller_class][online_message][mid] <= u){
+                high = mid;
+            }else{
+                low = mid + 1;
             }
+        }
+        current_period = low;
 
-            /*BEGIN BLOCK*/
-            /*In this block, we add the waiting time of this answered call to a table for figuring out pt (the service probabilities at the beginning of the next iteration.*/
-			delay=floor(sim_time-transfer[1]);
-			if (delay>0 && num_custs_delayed>=transient){
-				for (i=1; i<=delay; ++i){
-				atrisk[online_message][1][i]=atrisk[online_message][1][i]+1;
-				}
-			}
-			/*END BLOCK*/
+    }else{
 
-            /*Schedule next arrival for caller*/
-            next_arrival_period = ceil(expon(Avg_Interstring_Time[caller_class],STREAM)); /*Generate from caller's arrival rate*/
-            event_schedule(sim_time+next_arrival_period,EVENT_ARRIVAL);
+        /*The caller outlasts the table, so draw the remaining periods from the geometric tail*/
+        survival = abandon_survival[caller_class][online_message][T_max];
+        hazard = abandon_hazard_tail[caller_class][online_message];
+        if (hazard <= 0 || log(1-hazard) >= 0){
+            return; /*Caller never abandons*/
+        }
+        tail = ceil(log(u/survival)/log(1-hazard));
+        if (tail > INT_MAX - T_max){
+            return; /*A tiny tail hazard puts the renege beyond any run, so the caller never abandons*/
+        }
+        current_period = T_max + (int) tail;
+    }
 
-		}else{ /*Caller chooses to wait in online queue. Place back in queue.*/
-			list_file(LAST,LIST_ONLINE_QUEUE);
-		}
-	  } /*Done looping through callers*/
-	}
-	/*Schedule the next abandonment decision event one period from now*/
-	event_schedule(sim_time+1,EVENT_ABANDON_DECISION);
+    /*Schedule the renege event, tagged with the caller's ticket for this visit*/
+    transfer[3] = renege_ticket[caller_number];
+    transfer[10] = caller_number;
+    event_schedule(sim_time + current_period - 1 + 0.01, EVENT_RENEGE);
+}
+
+/*******************************************************************************************/
+
+void renege(void)  /* Renege event function. */
+{
+    /*Ignore the event if the caller has joined the online queue again since it was scheduled*/
+    caller_number = transfer[10];
+    if (transfer[3] != renege_ticket[caller_number]){
+        return;
+    }
+
+    /*Remove the caller from the online queue. If they are no longer there, they were served first.*/
+    if (list_remove_match(LIST_ONLINE_QUEUE, 10, caller_number)){
+        abandon();
+    }
+}
+
+/*******************************************************************************************/
+
+void customer_done(float wait)  /* Customer count function. */
+{
+    /*Increment num_custs_delayed and record starttime if the transient threshold has been passed*/
+    ++num_custs_delayed;
+    if (num_custs_delayed==warmup_customers){
+        starttime=sim_time;
+    }
+
+    /*In warmup_mode 1, until the warm-up is over, feed the waiting time to the MSER-5 detector. Once it finds the truncation point, the
+    warm-up ends with the next customer, and the simlib statistics start over from here.*/
+    if (warmup_mode==1 && num_custs_delayed<warmup_customers-1){
+        if (mser_observe(wait)){
+            warmup_customers = num_custs_delayed+1;
+            sampst(0.0, 0);
+            timest_restart();
+            printf("Warm-up ends after %d customers (MSER-5 truncation point %ld)\n",num_custs_delayed,mser_truncation());
+        }
+    }
+
+    /*In selection_mode 1, every selection_batch customers after the warm-up end a batch of the selection procedure*/
+    if (selection_active==1 && num_custs_delayed>=warmup_customers && (num_custs_delayed-warmup_customers)%selection_batch==0){
+        selection_batch_done();
+    }
+
+    /*In stopping_mode 1, every stopping_batch customers after the warm-up end a batch and check the precision*/
+    if ((stopping_mode==1 || control_mode==1 || staffing_mode==1) && num_custs_delayed>=warmup_customers && (num_custs_delayed-warmup_customers)%stopping_batch==0){
+        check_precision();
+    }
+}
+
+/*******************************************************************************************/
+
+void log_call(int queue, int outcome, int server, float wait)  /* Call log function. */
+{
+    /*A call that ended in a queue has its record in the transfer array. A call that ended on arrival is the current caller, whose
+    messages were only drawn if no server was idle.*/
+    long row;
+
+    row = call_log_rows;
+    if (queue>0){
+        call_log_caller[row] = transfer[10];
+        call_log_class[row] = Latent_Class[(int) transfer[10]];
+        call_log_arrival[row] = transfer[1];
+        call_log_decision[row] = (queue==1) ? CALL_DECISION_ONLINE : CALL_DECISION_CALLBACK;
+        call_log_online_message[row] = transfer[4];
+        call_log_offline_message[row] = transfer[5];
+        call_log_callback_type[row] = transfer[6];
+    }else if (outcome==CALL_ANSWERED){
+        call_log_caller[row] = caller_number;
+        call_log_class[row] = caller_class;
+        call_log_arrival[row] = sim_time;
+        call_log_decision[row] = CALL_DECISION_NONE;
+        call_log_online_message[row] = -1;
+        call_log_offline_message[row] = -1;
+        call_log_callback_type[row] = 0;
+    }else{
+        call_log_caller[row] = caller_number;
+        call_log_class[row] = caller_class;
+        call_log_arrival[row] = sim_time;
+        call_log_decision[row] = CALL_DECISION_ABANDON;
+        call_log_online_message[row] = online_message;
+        call_log_offline_message[row] = offline_message;
+        call_log_callback_type[row] = callback_type;
+    }
+    call_log_queue[row] = queue;
+    call_log_wait[row] = wait;
+    call_log_outcome[row] = outcome;
+    call_log_server[row] = server;
+
+    ++call_log_rows;
+    if (call_log_rows==CALL_LOG_BLOCK){
+        call_log_write();
+    }
+}
+
+/*******************************************************************************************/
+
+void call_log_start(void)  /* Call log opening function. */
+{
+    sprintf(call_log_file,"calls_%d_%d_%d%s.bin",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "");
+    call_log = fopen(call_log_file, "wb");
+    if (call_log == NULL) {
+        printf("Could not open %s\n", call_log_file);
+        exit(1);
+    }
+
+    memset(&call_log_header, 0, sizeof(call_log_header));
+    memcpy(call_log_header.magic, "SIMCALLS", 8);
+    call_log_header.version = 1;
+    call_log_header.block = CALL_LOG_BLOCK;
+    call_log_header.columns = CALL_LOG_COLUMNS;
+    call_log_header.servers = n_servers;
+    call_log_header.policy = policy_number;
+    call_log_header.iteration = iter;
+    call_log_header.antithetic = antithetic_run;
+    call_log_header.first_customer = num_custs_delayed;
+    call_log_header.period_length = period_length;
+    fwrite(&call_log_header, sizeof(call_log_header), 1, call_log);
+    call_log_rows = 0;
+}
+
+/*******************************************************************************************/
+
+void call_log_write(void)  /* Call log block function. */
+{
+    /*A block is its number of calls and then its columns, each written whole*/
+    if (call_log_rows==0){
+        return;
+    }
+    fwrite(&call_log_rows, sizeof(call_log_rows), 1, call_log);
+    fwrite(call_log_caller, sizeof(call_log_caller[0]), call_log_rows, call_log);
+    fwrite(call_log_class, sizeof(call_log_class[0]), call_log_rows, call_log);
+    fwrite(call_log_arrival, sizeof(call_log_arrival[0]), call_log_rows, call_log);
+    fwrite(call_log_decision, sizeof(call_log_decision[0]), call_log_rows, call_log);
+    fwrite(call_log_queue, sizeof(call_log_queue[0]), call_log_rows, call_log);
+    fwrite(call_log_online_message, sizeof(call_log_online_message[0]), call_log_rows, call_log);
+    fwrite(call_log_offline_message, sizeof(call_log_offline_message[0]), call_log_rows, call_log);
+    fwrite(call_log_callback_type, sizeof(call_log_callback_type[0]), call_log_rows, call_log);
+    fwrite(call_log_wait, sizeof(call_log_wait[0]), call_log_rows, call_log);
+    fwrite(call_log_outcome, sizeof(call_log_outcome[0]), call_log_rows, call_log);
+    if (fwrite(call_log_server, sizeof(call_log_server[0]), call_log_rows, call_log) != (size_t) call_log_rows){
+        printf("Could not write %s\n", call_log_file);
+        exit(1);
+    }
+    call_log_rows = 0;
+}
+
+/*******************************************************************************************/
+
+void call_log_stop(void)  /* Call log closing function. */
+{
+    /*Write the last block, and fill in the warm-up, which warmup_mode 1 only finds during the run*/
+    call_log_write();
+    call_log_header.warmup_customers = warmup_customers;
+    fseek(call_log, 0, SEEK_SET);
+    fwrite(&call_log_header, sizeof(call_log_header), 1, call_log);
+    if (fclose(call_log) != 0){
+        printf("Could not write %s\n", call_log_file);
+        exit(1);
+    }
+}
+
+/*******************************************************************************************/
+
+void sample_series(void)  /* Time series sampling function. */
+{
+    /*The state between two events is constant, so every sample due since the last event sees the state just before this one*/
+    int busy;
+
+    while (series_due()){
+        busy=0;
+        for (i=1; i<=n_servers; ++i){
+            busy=busy+server_status[i];
+        }
+        series_sample(list_size[LIST_ONLINE_QUEUE], SERIES_ONLINE_QUEUE);
+        series_sample(list_size[LIST_OFFLINE_QUEUE], SERIES_OFFLINE_QUEUE);
+        series_sample(timest_level(VAR_CALLBACKS_PENDING), SERIES_CALLBACKS_PENDING);
+        series_sample(busy, SERIES_BUSY_SERVERS);
+        series_sample(num_custs_delayed, SERIES_CUSTOMERS);
+        series_sample(calls_received[1]>0 ? calls_abandoned/calls_received[1] : 0, SERIES_ABANDON_RATE);
+        series_next();
+    }
+}
+
+/*******************************************************************************************/
+
+void write_series(void)  /* Time series report function. */
+{
+    char series_file[80];
+    FILE *series;
+    long dropped;
+
+    sprintf(series_file,"series_%d_%d_%d%s.csv",n_servers,policy_number,iter,antithetic_run==1 ? "_antithetic" : "");
+    series = fopen(series_file, "w");
+    if (series == NULL) {
+        printf("Could not open %s\n", series_file);
+        exit(1);
+    }
+    dropped = out_series(series, series_names);
+    fclose(series);
+    series_stop();
+    if (dropped>0){
+        printf("%s is missing the last %ld samples, beyond series_rows\n",series_file,dropped);
+    }
+}
+
+/*******************************************************************************************/
+
+void check_precision(void)  /* Precision check function. */
+{
+    /*batchst reports in the transfer array, which holds the record of the current caller, so keep a copy*/
+    double saved_transfer[1+4];
+    double busy_time;
+    int k;
+
+    for (k=1; k<=4; ++k){
+        saved_transfer[k]=transfer[k];
+    }
+
+    /*Find the totals so far, including the time the busy servers have spent on their current callers*/
+    busy_time=sum_busy_time;
+    for (k=1; k<=n_servers; ++k){
+        busy_time=busy_time+server_status[k]*(sim_time-server_intime[k]);
+    }
+
+    /*Pass this batch's AWT, abandonment rate and utilization to simlib's batch means. The first call, at the end of the warm-up, only
+    starts the first batch.*/
+    if (num_custs_delayed>warmup_customers){
+        if (sum_calls_received>batch_calls_received){
+            batchst((sum_wait_time-batch_wait_time)/(sum_calls_received-batch_calls_received)*period_length, BVAR_AWT);
+        }
+        if (sum_calls_received_online>batch_calls_received_online){
+            batchst((sum_calls_abandoned-batch_calls_abandoned)/(sum_calls_received_online-batch_calls_received_online), BVAR_ABANDON_RATE);
+        }
+        if (sim_time>batch_start){
+            batchst((busy_time-batch_busy_time)/(n_servers*(sim_time-batch_start)), BVAR_UTILIZATION);
+        }
+
+        /*In control_mode 1, the same batch AWT and abandonment rate go to the control-variate estimators, with the batch's mean service
+        time as the control. The arrivals per period are not a control: their mean is shifted by the ceiling on the interarrival times and
+        by the callers in the system, who start no new call string, so it is not known exactly. The second control is left at 0, unused.*/
+        if (control_mode==1 && services_started>batch_services){
+            cv_controls[0]=(service_total-batch_service_total)/(services_started-batch_services);
+            cv_controls[1]=0;
+            if (sum_calls_received>batch_calls_received){
+                cvst((sum_wait_time-batch_wait_time)/(sum_calls_received-batch_calls_received)*period_length, cv_controls, CVAR_AWT);
+            }
+            if (sum_calls_received_online>batch_calls_received_online){
+                cvst((sum_calls_abandoned-batch_calls_abandoned)/(sum_calls_received_online-batch_calls_received_online), cv_controls, CVAR_ABANDON_RATE);
+            }
+        }
+    }
+    batch_service_total=service_total;
+    batch_services=services_started;
+    batch_wait_time=sum_wait_time;
+    batch_calls_received=sum_calls_received;
+    batch_calls_received_online=sum_calls_received_online;
+    batch_calls_abandoned=sum_calls_abandoned;
+    batch_busy_time=busy_time;
+    batch_start=sim_time;
+
+    /*In stopping_mode 1, stop the run once every interval is based on at least half the batch slots and is within the target precision*/
+    if (stopping_mode==1){
+        precision_reached=1;
+        for (k=BVAR_AWT; k<=BVAR_UTILIZATION; ++k){
+            batchst(0.0, -k);
+            if (transfer[3]<BATCH_SLOTS/2 || transfer[2]>target_precision*fabs(transfer[1])){
+                precision_reached=0;
+            }
+        }
+        if (precision_reached==1){
+            customers_required=num_custs_delayed;
+            printf("Target precision reached after %d customers\n",num_custs_delayed);
+        }
+    }
+
+    for (k=1; k<=4; ++k){
+        transfer[k]=saved_transfer[k];
+    }
 }
 
 /*******************************************************************************************/
@@ -1133,6 +2642,318 @@ int  empric_cdf(float cdf_value, int arr_serv_no) /*To use the emprical distribu
 
 /*******************************************************************************************/
 
+void reset_streams(void)  /* Random number reset function. */
+{
+    long seed;
+
+    /*Start STREAM over. In crn_mode 1 and 2, the purpose streams start STREAM_SPACING draws apart in the sequence of STREAM, so they do not
+    overlap in runs of fewer draws than that*/
+    lcgrandst(STREAM_SEED,STREAM);
+    if (crn_mode>=1){
+        for (i=STREAM_ARRIVAL; i<=STREAM_CALLBACK; ++i){
+            lcgrandst(lcgrand_skip(STREAM_SEED,(i-STREAM_ARRIVAL)*(long)STREAM_SPACING),i);
+        }
+    }
+
+    /*In crn_mode 2, the callers' substreams follow, CALLER_SPACING draws apart, which together still fit into the period of the generator*/
+    if (crn_mode==2){
+        seed=lcgrand_skip(STREAM_SEED,(STREAM_CALLBACK-STREAM_ARRIVAL+1)*(long)STREAM_SPACING);
+        for (i=1; i<=N_Callers; ++i){
+            for (j=STREAM_ARRIVAL; j<=STREAM_SERVICE; ++j){
+                caller_seed[i][j]=seed;
+                caller_draws[i][j]=0;
+                seed=lcgrand_skip(seed,CALLER_SPACING);
+            }
+        }
+    }
+}
+
+/*******************************************************************************************/
+
+int stream_for(int purpose, int caller)  /* Stream choice function. */
+{
+    /*Every use of the returned stream draws a single number. In crn_mode 2, the arrival and service draws of a caller come from their own
+    substream, so its seed is loaded into the purpose stream and moved one draw ahead. A caller who used up CALLER_SPACING draws would
+    go on into the next substream, so the run stops instead.*/
+    if (crn_mode==0){
+        return STREAM;
+    }
+    if (crn_mode==2 && purpose<=STREAM_SERVICE){
+        if (caller_draws[caller][purpose]==CALLER_SPACING){
+            printf("Caller %d needs more than CALLER_SPACING=%d draws of stream %d, which would overlap the next substream; raise CALLER_SPACING\n",
+                caller,CALLER_SPACING,purpose);
+            exit(1);
+        }
+        ++caller_draws[caller][purpose];
+        lcgrandst(caller_seed[caller][purpose],purpose);
+        caller_seed[caller][purpose]=lcgrand_skip(caller_seed[caller][purpose],1);
+    }
+    return purpose;
+}
+
+/*******************************************************************************************/
+
+void pair_streams(int antithetic)  /* Antithetic stream function. */
+{
+    /*The first run of a pair keeps the seeds it starts from, and its partner starts from the same seeds*/
+    if (antithetic==0){
+        for (i=STREAM; i<=STREAM_CALLBACK; ++i){
+            pair_seed[i]=lcgrandgt(i);
+        }
+        if (crn_mode==2){
+            for (i=1; i<=N_Callers; ++i){
+                for (j=STREAM_ARRIVAL; j<=STREAM_SERVICE; ++j){
+                    pair_caller_seed[i][j]=caller_seed[i][j];
+                    pair_caller_draws[i][j]=caller_draws[i][j];
+                }
+            }
+        }
+    }else{
+        for (i=STREAM; i<=STREAM_CALLBACK; ++i){
+            lcgrandst(pair_seed[i],i);
+        }
+        if (crn_mode==2){
+            for (i=1; i<=N_Callers; ++i){
+                for (j=STREAM_ARRIVAL; j<=STREAM_SERVICE; ++j){
+                    caller_seed[i][j]=pair_caller_seed[i][j];
+                    caller_draws[i][j]=pair_caller_draws[i][j];
+                }
+            }
+        }
+    }
+
+    /*The partner's streams return 1-u for every u*/
+    for (i=STREAM; i<=STREAM_CALLBACK; ++i){
+        lcgrand_antithetic(i,antithetic);
+    }
+}
+
+/*******************************************************************************************/
+
+int start_n_servers(void)  /* First server count function. */
+{
+    int policy;
+
+    if (staffing_mode==1){
+        if (branch_mode==1 || selection_mode==1){
+            printf("staffing_mode 1 simulates the policies at different server counts, so it cannot be combined with branch_mode 1 or selection_mode 1\n");
+            exit(1);
+        }
+        /*Before any run, the smallest acceptable server count may be any of them, or none (highest_n_servers is assumed acceptable
+        until it is simulated)*/
+        for (policy=lowest_policy_number; policy<=highest_policy_number; ++policy){
+            staffing_low[policy] = -1;
+            staffing_high[policy] = (highest_n_servers-lowest_n_servers)/server_jump;
+            for (i=0; i<=staffing_high[policy]; ++i){
+                staffing_tested[policy][i] = 0;
+            }
+        }
+        n_servers = lowest_n_servers-server_jump;
+        return next_n_servers();
+    }
+    return lowest_n_servers;
+}
+
+/*******************************************************************************************/
+
+int next_n_servers(void)  /* Next server count function. */
+{
+    int policy, next, best;
+
+    if (staffing_mode==0){
+        return n_servers+server_jump;
+    }
+
+    /*The smallest server count still needed by a policy's search. Ties between policies share the runs of that server count.*/
+    best = highest_n_servers+1;
+    for (policy=lowest_policy_number; policy<=highest_policy_number; ++policy){
+        next = staffing_next(policy);
+        if (next>0 && next<best){
+            best = next;
+        }
+    }
+    return best;
+}
+
+/*******************************************************************************************/
+
+int staffing_next(int policy)  /* Staffing search step function. */
+{
+    /*Bisect the server counts between the largest one known to miss the target and the smallest one known (or assumed) to meet it*/
+    if (staffing_high[policy]-staffing_low[policy]>1){
+        return lowest_n_servers+(staffing_low[policy]+(staffing_high[policy]-staffing_low[policy])/2)*server_jump;
+    }
+    if (staffing_low[policy]<staffing_high[policy] && staffing_tested[policy][staffing_high[policy]]==0){
+        return lowest_n_servers+staffing_high[policy]*server_jump;
+    }
+    return 0;
+}
+
+/*******************************************************************************************/
+
+void staffing_update(void)  /* Staffing search update function. */
+{
+    int step;
+
+    /*The estimate of the output is the mean of the last run's batches, which excludes the warm-up*/
+    step = (n_servers-lowest_n_servers)/server_jump;
+    batchst(0.0, staffing_output==1 ? -BVAR_AWT : -BVAR_ABANDON_RATE);
+    staffing_mean[policy_number][step] = transfer[1];
+    staffing_halfwidth[policy_number][step] = transfer[2];
+    staffing_tested[policy_number][step] = 1;
+    printf("Staffing search, policy %d: %d servers give %g +/- %g against the target %g\n",policy_number,n_servers,transfer[1],transfer[2],staffing_target);
+
+    /*Noisy bisection: the point estimate decides the side, and the intervals are reported with the result*/
+    if (transfer[1]<=staffing_target){
+        staffing_high[policy_number] = step;
+    }else{
+        staffing_low[policy_number] = step;
+    }
+}
+
+/*******************************************************************************************/
+
+void report_staffing(void)  /* Staffing search report function. */
+{
+    /*The smallest acceptable server count of each policy, with the intervals at it and one step below. The result is certain at the 95%
+    level of each interval only if neither interval contains the target.*/
+    int policy, high, low, runs;
+
+    for (policy=lowest_policy_number; policy<=highest_policy_number; ++policy){
+        high = staffing_high[policy];
+        low = staffing_low[policy];
+        runs = 0;
+        for (i=0; i<=(highest_n_servers-lowest_n_servers)/server_jump; ++i){
+            runs = runs+staffing_tested[policy][i];
+        }
+        if (low==high){
+            printf("Policy %d: even %d servers miss the target (%g +/- %g), after %d server counts\n",policy,lowest_n_servers+high*server_jump,
+                staffing_mean[policy][high],staffing_halfwidth[policy][high],runs);
+            continue;
+        }
+        printf("Policy %d: %d servers are the fewest that meet the target (%g +/- %g), after %d server counts",policy,lowest_n_servers+high*server_jump,
+            staffing_mean[policy][high],staffing_halfwidth[policy][high],runs);
+        if (low>=0){
+            printf("; %d servers give %g +/- %g",lowest_n_servers+low*server_jump,staffing_mean[policy][low],staffing_halfwidth[policy][low]);
+        }
+        if (staffing_mean[policy][high]+staffing_halfwidth[policy][high]<=staffing_target
+            && (low<0 || staffing_mean[policy][low]-staffing_halfwidth[policy][low]>staffing_target)){
+            printf(" (confident)\n");
+        }else{
+            printf(" (not confident: an interval contains the target, so longer runs are needed)\n");
+        }
+    }
+}
+
+/*******************************************************************************************/
+
+void report_pairs(void)  /* Antithetic pair report function. */
+{
+    /*Pair averages, with their variance against the variance of the average of two independent runs. The ratio is the variance reduction.*/
+    pairst(0.0, -PVAR_AWT);
+    printf("Antithetic pairs: AWT %g (variance %g, independent runs %g, %.0f pairs)\n",transfer[1],transfer[2],transfer[4],transfer[3]);
+    pairst(0.0, -PVAR_ABANDON_RATE);
+    printf("Antithetic pairs: abandon rate %g (variance %g, independent runs %g, %.0f pairs)\n",transfer[1],transfer[2],transfer[4],transfer[3]);
+}
+
+/*******************************************************************************************/
+
+double wall_clock(void)  /* Wall clock function. */
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec+1.E-9*now.tv_nsec;
+}
+
+/*******************************************************************************************/
+
+void report_progress(void)  /* Progress report function. */
+{
+    /*The time left for the run is extrapolated from its customers so far, and the time left for all runs from the runs so far, counting
+    the current run by its fraction of customers*/
+    double now, done, run_left, all_left;
+    char line[512], status_file[64];
+    FILE *status;
+
+    now = wall_clock();
+    if (now-progress_clock<progress_interval){
+        return;
+    }
+    done = (double) num_custs_delayed/customers_required;
+    run_left = (done>0) ? (now-progress_run_start)/done*(1-done) : 0;
+    all_left = (done>0) ? (now-progress_start)/(iteration_count-1+done)*(runs_planned-iteration_count+1-done) : 0;
+    if (all_left<run_left){
+        all_left = run_left;
+    }
+    sprintf(line,"Servers = %d, Policy = %d, Iteration %d (run %d of %d): %d of %d customers (%.1f%%), time %.0f periods, %.0f events/s, queues %d online %d offline, %.0f s left in the run, %.0f s left in all runs\n",
+        n_servers,policy_number,iter,iteration_count,runs_planned,num_custs_delayed,customers_required,100*done,sim_time,
+        (events_processed-progress_events)/(now-progress_clock),list_size[LIST_ONLINE_QUEUE],list_size[LIST_OFFLINE_QUEUE],run_left,all_left);
+    progress_clock = now;
+    progress_events = events_processed;
+
+    if (progress_mode==1){
+        fputs(line,stderr);
+    }else{
+        /*Every process writes its own temporary file, since the branched policies report at the same time*/
+        sprintf(status_file,"Progress_%ld.tmp",(long) getpid());
+        status = fopen(status_file,"w");
+        if (status!=NULL){
+            fputs(line,status);
+            fclose(status);
+            rename(status_file,"Progress.txt");
+        }
+    }
+}
+
+/*******************************************************************************************/
+
+void bench_phase(int phase)  /* Phase timing function. */
+{
+    /*Charge the time since the last phase change to phase (none for 0)*/
+    double now;
+
+    if (bench_mode==0){
+        return;
+    }
+    now = wall_clock();
+    if (phase>0){
+        phase_time[phase] = phase_time[phase]+now-phase_clock;
+    }
+    phase_clock = now;
+}
+
+/*******************************************************************************************/
+
+void bench_record(void)  /* Timing report function. */
+{
+    /*Write the timing and memory row of the run just recorded, and start the phase times of the next one*/
+    struct rusage usage;
+    struct memory_telemetry memory;
+    long allocs, frees;
+
+    if (bench_mode==0){
+        return;
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    memory_get(&memory);
+    allocs=0;
+    frees=0;
+    for (i=1; i<=MAX_MEM; ++i){
+        allocs=allocs+memory.allocs[i];
+        frees=frees+memory.frees[i];
+    }
+    fprintf(benchfile,"%d,%d,%d,%ld,%.0f,%ld,%ld,%.3f,%.3f,%.3f,%.3f,%ld,%ld,%lu,%ld\n",n_servers,policy_number,iter,events_processed,
+        phase_time[PHASE_EVENTS]>0 ? events_processed/phase_time[PHASE_EVENTS] : 0.0,event_list_peak,(long) usage.ru_maxrss,
+        phase_time[PHASE_BELIEFS],phase_time[PHASE_INIT],phase_time[PHASE_EVENTS],phase_time[PHASE_RECORD],
+        allocs,frees,(unsigned long) memory.event_bytes,memory.event_growths);
+    for (i=PHASE_BELIEFS; i<=PHASE_RECORD; ++i){
+        phase_time[i]=0;
+    }
+}
+
+/*******************************************************************************************/
+
 void record(void)  /* Report generator function. */
 {
     /* Get and write out estimates of desired measures of performance. */
@@ -1163,6 +2984,9 @@ void record(void)  /* Report generator function. */
 
     avg_queue_length[1]=filest(1);
     avg_queue_length[2]=filest(2);
+    if (callback_mode==1){
+        avg_queue_length[2]=avg_queue_length[2]+timest(0.0,-VAR_CALLBACKS_PENDING); /*Add the callbacks that were not yet due*/
+    }
     avg_queue_length_total= avg_queue_length[1]+avg_queue_length[2];
 
     percent_accept_callback= callbacks_accepted / callbacks_offered;
@@ -1172,7 +2996,26 @@ void record(void)  /* Report generator function. */
     Rho_On = (calls_received[1]/(sim_time-starttime))/(n_servers/(avg_service_time*periods_per_minute)-calls_answered[2]/(sim_time-starttime));
     Rho_All = (calls_received_total/(sim_time-starttime))/(n_servers/(avg_service_time*periods_per_minute));
 
-    fprintf(outfile,"%d,%d,%d,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f\n"
+    p90_answer[1] = sampst_quantile(VAR_ANSWER_ONLINE, 0.90);
+    p99_answer[1] = sampst_quantile(VAR_ANSWER_ONLINE, 0.99);
+    p90_answer[2] = sampst_quantile(VAR_ANSWER_OFFLINE, 0.90);
+    p99_answer[2] = sampst_quantile(VAR_ANSWER_OFFLINE, 0.99);
+
+    /*Batch-means estimates of AWT and abandonment rate, raw and adjusted with the control variates*/
+    if (control_mode==1){
+        cv_means[0]=service_mean;
+        cv_means[1]=0;
+        cvst(0.0, cv_means, -CVAR_AWT);
+        for (i=1; i<=4; ++i){
+            awt_cv[i]=transfer[i];
+        }
+        cvst(0.0, cv_means, -CVAR_ABANDON_RATE);
+        for (i=1; i<=4; ++i){
+            abandon_rate_cv[i]=transfer[i];
+        }
+    }
+
+    fprintf(outfile,"%d,%d,%d,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f"
         ,iter,n_servers,policy_number,Throughput,AWT_All,AWT[1],Rho_On,Rho_All,AWT[1],AWT[2],AWT_total,
         calls_received[1],calls_received[2],calls_received_total,
         calls_answered[1],calls_answered[2],calls_answered_total,
@@ -1180,5 +3023,11 @@ void record(void)  /* Report generator function. */
         abandon_rate,callback_not_answer_rate,no_service_rate,
         avg_queue_length[1],avg_queue_length[2],avg_queue_length_total,
         server_util_total,sim_time-starttime,
-        percent_accept_callback,percent_answer_callback);
+        percent_accept_callback,percent_answer_callback,
+        p90_answer[1],p99_answer[1],p90_answer[2],p99_answer[2]);
+    if (control_mode==1){
+        fprintf(outfile,",%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f,%16.10f",
+            awt_cv[1],awt_cv[2],awt_cv[3],awt_cv[4],abandon_rate_cv[1],abandon_rate_cv[2],abandon_rate_cv[3],abandon_rate_cv[4]);
+    }
+    fprintf(outfile,"\n");
 }
@@ -0,0 +1,95 @@
+/* This is trace_replay.c, the reader of simlib event traces.
+
+   Usage: trace_replay file                 summary of the trace
+          trace_replay file index [count]   count events (20 by default)
+                                            from event number index on
+
+   Records have a fixed size, so an event is found by seeking straight to
+   it.  To re-run the simulation from an event with the model's state, run
+   the model in its trace replay mode (trace_mode 2), which checks every
+   event against the trace and prints the events from trace_from on.  It
+   re-runs from the start, or from the last snapshot of the state before
+   trace_from if the trace was recorded with trace_snapshot. */
+
+#include "simlib.h"
+#include <string.h>
+
+#define TRACE_TYPES 64          /* Event types counted in the summary. */
+
+static void print_record(const struct trace_record *record)
+{
+    int i;
+
+    printf("Event %ld at time %.6f: type %ld, attributes", record->index,
+           record->time, record->type);
+    for(i = 0; i < TRACE_ATTR; ++i) printf(" %g", record->attribute[i]);
+    printf(", streams");
+    for(i = 0; i < TRACE_STREAMS; ++i) printf(" %ld", record->stream[i]);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct trace_header header;
+    struct trace_record record, first;
+    FILE  *unit;
+    long   index, count, records, type_count[TRACE_TYPES + 1];
+    int    type;
+
+    if(argc < 2 || argc > 4) {
+        printf("Usage: trace_replay file [index [count]]\n");
+        exit(1);
+    }
+    unit = fopen(argv[1], "rb");
+    if(unit == NULL) {
+        printf("Could not open trace file %s\n", argv[1]);
+        exit(1);
+    }
+    if(fread(&header, sizeof(header), 1, unit) != 1 ||
+       memcmp(header.magic, "SIMTRACE", 8) != 0 ||
+       header.record_size != (long) sizeof(struct trace_record)) {
+        printf("%s is not a trace file of this simlib\n", argv[1]);
+        exit(1);
+    }
+    if(fread(&first, sizeof(first), 1, unit) != 1) {
+        printf("%s has no events\n", argv[1]);
+        return 0;
+    }
+
+    /* Summary: the events, their time span and their types. */
+
+    if(argc == 2) {
+        for(type = 0; type <= TRACE_TYPES; ++type) type_count[type] = 0;
+        record  = first;
+        records = 0;
+        do {
+            ++records;
+            type = (record.type >= 0 && record.type <= TRACE_TYPES)
+                   ? (int) record.type : 0;
+            ++type_count[type];
+        } while(fread(&record, sizeof(record), 1, unit) == 1);
+        printf("%s: %ld events, numbers %ld to %ld, time %.6f to %.6f\n",
+               argv[1], records, first.index, record.index, first.time,
+               record.time);
+        for(type = 0; type <= TRACE_TYPES; ++type)
+            if(type_count[type] > 0)
+                printf("  type %2d: %ld events\n", type, type_count[type]);
+        fclose(unit);
+        return 0;
+    }
+
+    /* Jump to event number index. */
+
+    index = atol(argv[2]);
+    count = (argc == 4) ? atol(argv[3]) : 20;
+    if(index < first.index) {
+        printf("The trace starts at event %ld\n", first.index);
+        exit(1);
+    }
+    fseek(unit, (long) sizeof(header) + (index - first.index) *
+          (long) sizeof(struct trace_record), SEEK_SET);
+    for(; count > 0 && fread(&record, sizeof(record), 1, unit) == 1; --count)
+        print_record(&record);
+    fclose(unit);
+    return 0;
+}